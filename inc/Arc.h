@@ -0,0 +1,116 @@
+/*
+ * Arc.h
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef ARC_H_
+#define ARC_H_
+
+#include "stm32f4xx_hal.h"
+#include "Planner.h"
+
+//Bits fracionários do vetor raio, em passos
+#define ARC_FRACTION_BITS 8
+
+//Bits fracionários dos coeficientes de rotação
+#define ARC_ROTATION_BITS 30
+
+//Quantidade de segmentos entre correções exatas do vetor raio
+#define ARC_CORRECTION 12
+
+//Diferença relativa máxima entre o raio inicial e o final no formato I/J
+#define ARC_RADIUS_ERROR 0.002f
+
+/**
+ * Interpolador de arcos no plano XY. Gera os pontos dos segmentos em passos,
+ * girando o vetor raio em ponto fixo a cada segmento
+ */
+class Arc {
+private:
+	bool error;												//True se o arco for inválido
+	bool clockwise;											//True para sentido horário (G2)
+
+	int32_t target[N_AXIS];									//Ponto final em passos
+	int32_t center[N_AXIS];									//Centro em passos, ponto fixo Q8
+	int32_t start[N_AXIS];									//Vetor raio inicial em passos, ponto fixo Q8
+	int32_t radius[N_AXIS];									//Vetor raio atual em passos, ponto fixo Q8
+
+	int32_t cosTheta;										//Cosseno do ângulo de cada segmento, ponto fixo Q30
+	int32_t sinTheta;										//Seno do ângulo de cada segmento, ponto fixo Q30
+	float theta;											//Ângulo de cada segmento em radianos
+
+	uint32_t segments;										//Quantidade total de segmentos
+	uint32_t segment;										//Segmento atual
+
+	/**
+	 * Calcula o ângulo e a quantidade de segmentos a partir do centro
+	 *
+	 * origin				Ponto inicial em passos
+	 * i					Distância em X do ponto inicial ao centro em passos
+	 * j					Distância em Y do ponto inicial ao centro em passos
+	 * tolerance			Erro máximo entre a corda e o arco em passos
+	 */
+	void init(const int32_t origin[N_AXIS], float i, float j, float tolerance);
+
+public:
+	/**
+	 * Construtor para arcos definidos pelo centro (I/J)
+	 *
+	 * origin				Ponto inicial em passos
+	 * target				Ponto final em passos
+	 * i					Distância em X do ponto inicial ao centro em passos
+	 * j					Distância em Y do ponto inicial ao centro em passos
+	 * clockwise			True para sentido horário (G2)
+	 * tolerance			Erro máximo entre a corda e o arco em passos
+	 */
+	Arc(const int32_t origin[N_AXIS], const int32_t target[N_AXIS], float i, float j, bool clockwise, float tolerance);
+
+	/**
+	 * Construtor para arcos definidos pelo raio (R). Raio negativo escolhe o
+	 * arco maior que meia volta
+	 *
+	 * origin				Ponto inicial em passos
+	 * target				Ponto final em passos
+	 * r					Raio em passos
+	 * clockwise			True para sentido horário (G2)
+	 * tolerance			Erro máximo entre a corda e o arco em passos
+	 */
+	Arc(const int32_t origin[N_AXIS], const int32_t target[N_AXIS], float r, bool clockwise, float tolerance);
+
+	/**
+	 * Calcula o final do próximo segmento. O último segmento termina
+	 * exatamente no ponto final
+	 *
+	 * point				Array onde o ponto em passos será escrito
+	 *
+	 * Retorna false quando não houver mais segmentos
+	 */
+	bool next(int32_t point[N_AXIS]);
+
+	/**
+	 * Retorna true se houver algum erro
+	 */
+	bool getError();
+};
+
+#endif /* ARC_H_ */
@@ -11,84 +11,234 @@
 #ifndef CIRCULARBUFFER_H_
 #define CIRCULARBUFFER_H_
 
-#include <cstdio>
-#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
 
 /**
- * Important Usage Note: This library reserves one spare entry for queue-full detection
- * Otherwise, corner cases and detecting difference between full/empty is hard.
- * You are not seeing an accidental off-by-one.
+ * Fila circular de um produtor e um consumidor (por exemplo a interrupção da
+ * serial e o loop principal), sem travas. Só o produtor escreve head_ e só o
+ * consumidor escreve tail_. Os índices correm livres e são mascarados no
+ * acesso, então as N posições são usadas e N precisa ser potência de 2.
+ * Os dados ficam no próprio objeto, sem alocação. Além de put e get por
+ * item, readSpan/consume e writeSpan/commit dão acesso direto aos trechos
+ * contínuos do buffer, para cópias em bloco ou DMA
+ *
+ * T					Tipo dos itens
+ * N					Capacidade, potência de 2
  */
-
-template <class T>
+template <class T, size_t N>
 class CircularBuffer {
+	static_assert((N >= 2) && ((N & (N - 1)) == 0), "CircularBuffer: N deve ser potencia de 2");
+
 public:
-	CircularBuffer(size_t size) :
-		buf_(std::unique_ptr<T[]>(new T[size])),
-		size_(size)
+	//Trecho contínuo do buffer
+	struct Span {
+		T* data;
+		size_t length;
+	};
+
+	CircularBuffer() :
+		head_(0),
+		tail_(0),
+		overflows_(0)
 	{
 		//Empty constructor
 	}
 
-	void put(T item) {
-		buf_[head_] = item;
-		head_ = (head_ + 1) % size_;
-
-		if (head_ == tail_) {
-			tail_ = (tail_ + 1) % size_;
+	/**
+	 * Produtor: insere um item. Se a fila estiver cheia o item é descartado,
+	 * o contador de overflows é incrementado e retorna false
+	 *
+	 * item					Item a ser inserido
+	 */
+	bool put(T item) {
+		size_t head = head_;
+		if (head - tail_ >= N) {
+			overflows_ = overflows_ + 1;
+			return false;
 		}
+
+		buf_[head & MASK] = item;
+
+		//O item precisa estar escrito antes de o consumidor ver o novo head_
+		std::atomic_signal_fence(std::memory_order_release);
+		head_ = head + 1;
+
+		return true;
 	}
 
+	/**
+	 * Consumidor: retira o item mais antigo, T() se a fila estiver vazia
+	 */
 	T get(void) {
-		if (empty()) {
+		size_t tail = tail_;
+		if (head_ == tail) {
 			return T();
 		}
 
-		//Read data and advance the tail (we now have a free space)
-		auto val = buf_[tail_];
-		tail_ = (tail_ + 1) % size_;
+		//Lê o item só depois de ver o head_ que o publicou, e libera a posição
+		//só depois de lido
+		std::atomic_signal_fence(std::memory_order_acquire);
+		T val = buf_[tail & MASK];
+		std::atomic_signal_fence(std::memory_order_release);
+		tail_ = tail + 1;
 
 		return val;
 	}
 
+	/**
+	 * Consumidor: retorna o item mais antigo sem retirá-lo, T() se vazia
+	 */
 	T peek(void) {
-		if (empty()) {
+		size_t tail = tail_;
+		if (head_ == tail) {
 			return T();
 		}
 
-		//Read data
-		auto val = buf_[tail_];
+		std::atomic_signal_fence(std::memory_order_acquire);
+		return buf_[tail & MASK];
+	}
 
-		return val;
+	/**
+	 * Consumidor: retorna o trecho contínuo de itens a partir do mais antigo.
+	 * Se os itens dão a volta no buffer o trecho vai só até o fim dele, e o
+	 * resto aparece na chamada seguinte a consume
+	 */
+	Span readSpan(void) {
+		size_t tail = tail_;
+		size_t count = head_ - tail;
+		std::atomic_signal_fence(std::memory_order_acquire);
+
+		size_t index = tail & MASK;
+		Span span = {&buf_[index], std::min(count, N - index)};
+		return span;
+	}
+
+	/**
+	 * Consumidor: libera os primeiros itens, já lidos de readSpan
+	 *
+	 * length				Quantidade de itens, no máximo o tamanho do trecho
+	 */
+	void consume(size_t length) {
+		std::atomic_signal_fence(std::memory_order_release);
+		tail_ = tail_ + length;
+	}
+
+	/**
+	 * Produtor: retorna o trecho contínuo livre a partir de head_, que pode
+	 * ser menor que o espaço livre se ele der a volta no buffer
+	 */
+	Span writeSpan(void) {
+		size_t head = head_;
+		size_t free = N - (head - tail_);
+		std::atomic_signal_fence(std::memory_order_acquire);
+
+		size_t index = head & MASK;
+		Span span = {&buf_[index], std::min(free, N - index)};
+		return span;
 	}
 
+	/**
+	 * Produtor: publica os primeiros itens escritos no trecho de writeSpan
+	 *
+	 * length				Quantidade de itens, no máximo o tamanho do trecho
+	 */
+	void commit(size_t length) {
+		std::atomic_signal_fence(std::memory_order_release);
+		head_ = head_ + length;
+	}
+
+	/**
+	 * Produtor: insere os itens que couberem, em no máximo duas cópias. Os que
+	 * não couberem são descartados e contados como overflows. Retorna o número
+	 * de itens inseridos
+	 *
+	 * data					Itens a serem inseridos
+	 * length				Quantidade de itens
+	 */
+	size_t write(const T* data, size_t length) {
+		size_t written = 0;
+		while (written < length) {
+			Span span = writeSpan();
+			if (span.length == 0) {
+				overflows_ = overflows_ + (length - written);
+				break;
+			}
+
+			size_t count = std::min(span.length, length - written);
+			std::copy(data + written, data + written + count, span.data);
+			commit(count);
+			written += count;
+		}
+
+		return written;
+	}
+
+	/**
+	 * Consumidor: retira até length itens, em no máximo duas cópias. Retorna
+	 * o número de itens lidos
+	 *
+	 * data					Destino dos itens
+	 * length				Quantidade máxima de itens
+	 */
+	size_t read(T* data, size_t length) {
+		size_t count = 0;
+		while (count < length) {
+			Span span = readSpan();
+			if (span.length == 0) {
+				break;
+			}
+
+			size_t chunk = std::min(span.length, length - count);
+			std::copy(span.data, span.data + chunk, data + count);
+			consume(chunk);
+			count += chunk;
+		}
+
+		return count;
+	}
+
+	/**
+	 * Consumidor: descarta todos os itens
+	 */
 	void reset(void) {
-		head_ = tail_;
+		tail_ = head_;
 	}
 
 	bool empty(void) {
-		//if head and tail are equal, we are empty
 		return head_ == tail_;
 	}
 
 	bool full(void) {
-		//If tail is ahead the head by 1, we are full
-		return ((head_ + 1) % size_) == tail_;
+		return size() >= N;
 	}
 
 	size_t size(void) {
-		return ((head_-tail_)&(size_ - 1));
+		//tail_ nunca passa head_, a diferença sem sinal é o número de itens
+		size_t tail = tail_;
+		return head_ - tail;
 	}
 
 	size_t capacity(void) {
-		return size_ - 1;
+		return N;
+	}
+
+	/**
+	 * Retorna o número de itens descartados por fila cheia
+	 */
+	uint32_t overflows(void) {
+		return overflows_;
 	}
 
 private:
-	std::unique_ptr<T[]> buf_;
-	size_t head_ = 0;
-	size_t tail_ = 0;
-	size_t size_;
+	static const size_t MASK = N - 1;
+
+	T buf_[N];
+	volatile size_t head_;				//Escrito só pelo produtor
+	volatile size_t tail_;				//Escrito só pelo consumidor
+	volatile uint32_t overflows_;		//Escrito só pelo produtor
 };
 
 #endif
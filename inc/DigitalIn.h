@@ -0,0 +1,97 @@
+/*
+ * DigitalIn.h
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef DIGITALIN_H_
+#define DIGITALIN_H_
+
+#include "stm32f4xx_hal.h"
+#include "Pins.h"
+
+class DigitalIn {
+private:
+	uint32_t pin;					//Pino do porta
+	GPIO_TypeDef* port;				//Porta a ser utilizada
+	GPIO_InitTypeDef config;		//Configuração do pino
+	bool error;						//False se nenhum erro ocorreu
+	void (*handler)();				//Função chamada pela interrupção do pino, NULL se nenhuma
+
+	/**
+	 * Retorna o número da linha da EXTI do pino
+	 */
+	uint8_t line();
+
+public:
+	/**
+	 * Construtor
+	 *
+	 * port					Porta que contém o pino a ser inicializado
+	 * pin					Número do pino
+	 * pull					Resistor interno (GPIO_NOPULL, GPIO_PULLUP ou GPIO_PULLDOWN)
+	 *
+	 */
+	DigitalIn(GPIO_TypeDef* port, uint32_t pin, uint32_t pull);
+
+	/**
+	 * Destrutor
+	 */
+	~DigitalIn();
+
+	/**
+	 * Retorna false se nível lógico baixo ou true se nível lógico alto na entrada.
+	 *
+	 */
+	bool read();
+
+	/**
+	 * Habilita a interrupção do pino pela EXTI. Cada linha da EXTI atende um
+	 * único pino entre todas as portas. Retorna false se a linha já estiver
+	 * em uso
+	 *
+	 * edge					Borda que gera a interrupção (GPIO_MODE_IT_RISING,
+	 * 						GPIO_MODE_IT_FALLING ou GPIO_MODE_IT_RISING_FALLING)
+	 * handler				Função chamada dentro da interrupção
+	 * priority				Prioridade da interrupção no NVIC
+	 *
+	 */
+	bool enableInterrupt(uint32_t edge, void (*handler)(), uint32_t priority);
+
+	/**
+	 * Desabilita a interrupção do pino
+	 */
+	void disableInterrupt();
+
+	/**
+	 * Callback da interrupção da EXTI
+	 */
+	void interruptCallback();
+
+	/**
+	 *	Retorna true se houver algum erro
+	 *
+	 */
+	bool getError();
+};
+
+#endif /* DIGITALIN_H_ */
@@ -0,0 +1,119 @@
+/*
+ * FastMath.h
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef FASTMATH_H_
+#define FASTMATH_H_
+
+#include <stdint.h>
+
+//O linker descarta a libm, então as funções matemáticas usadas no movimento
+//e na cinemática ficam aqui. O módulo não depende da HAL e também compila
+//no host: test/FastMathTest.cpp (make -C test) verifica a precisão contra a
+//libm do PC. Os ciclos citados são estimativas pelas instruções geradas para
+//a FPU do Cortex-M4F, não medições no alvo
+
+//Entradas da tabela de senos (potência de 2), o mesmo tamanho da tabela do CMSIS
+#define SIN_TABLE_SIZE 512
+
+#define FAST_PI 3.14159265358979f
+
+/**
+ * Raiz quadrada pela instrução VSQRT da FPU, arredondada corretamente
+ * (erro de até 0,5 ulp). Cerca de 14 ciclos (estimativa). Negativos retornam 0
+ *
+ * x					Valor de entrada
+ */
+inline float fastSqrt(float x) {
+	if (x <= 0.0f) {
+		return 0.0f;
+	}
+
+#if defined(__arm__) && defined(__ARM_FP)
+	float result;
+	__asm__ ("vsqrt.f32 %0, %1" : "=t" (result) : "t" (x));
+	return result;
+#else
+	return __builtin_sqrtf(x);
+#endif
+}
+
+/**
+ * Inverso pela instrução VDIV da FPU, arredondado corretamente (erro de até
+ * 0,5 ulp). Cerca de 14 ciclos (estimativa). O Cortex-M4 não tem
+ * instrução de inverso aproximado, então a divisão é o caminho mais rápido
+ * com precisão total
+ *
+ * x					Valor de entrada, diferente de zero
+ */
+inline float fastReciprocal(float x) {
+	return 1.0f / x;
+}
+
+/**
+ * Seno e cosseno juntos, pela entrada mais próxima da tabela e uma série de
+ * Taylor de terceira ordem a partir dela. Erro absoluto menor que 2e-7 para
+ * |angle| < 50 rad, limitado pela precisão do float. Cerca de 35 ciclos
+ * (estimativa)
+ *
+ * angle				Ângulo em radianos
+ * sin					Onde o seno será escrito
+ * cos					Onde o cosseno será escrito
+ */
+void fastSinCos(float angle, float* sin, float* cos);
+
+/**
+ * Seno pela tabela, com a precisão e o custo de fastSinCos
+ *
+ * angle				Ângulo em radianos
+ */
+float fastSin(float angle);
+
+/**
+ * Cosseno pela tabela, com a precisão e o custo de fastSinCos
+ *
+ * angle				Ângulo em radianos
+ */
+float fastCos(float angle);
+
+/**
+ * Arco tangente de y/x no quadrante correto, entre -pi e pi. Polinômio de
+ * grau 17 de Abramowitz e Stegun (4.4.49) no octante [0, 1]. Erro absoluto
+ * menor que 4e-7 rad. Cerca de 50 ciclos (estimativa). Retorna 0 para (0, 0)
+ *
+ * y					Coordenada y
+ * x					Coordenada x
+ */
+float fastAtan2(float y, float x);
+
+/**
+ * Arco seno, entre -pi/2 e pi/2, por fastAtan2 e fastSqrt. Entradas fora de
+ * [-1, 1] são limitadas. Erro absoluto menor que 3e-7 rad longe de +-1,
+ * onde a precisão do próprio float domina. Cerca de 70 ciclos (estimativa)
+ *
+ * x					Seno do ângulo
+ */
+float fastAsin(float x);
+
+#endif /* FASTMATH_H_ */
@@ -0,0 +1,78 @@
+/*
+ * PanTilt.h
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef PANTILT_H_
+#define PANTILT_H_
+
+#include "stm32f4xx_hal.h"
+#include "Planner.h"
+
+/**
+ * Cinemática inversa da cabeça pan/tilt. Calcula os ângulos dos eixos que
+ * apontam a linha de visada para um ponto cartesiano, considerando os
+ * offsets da montagem. O eixo pan é vertical e passa pela origem, com o
+ * ângulo crescendo de X para Y, e o tilt cresce para cima
+ */
+class PanTilt {
+private:
+	float height;						//Altura do eixo tilt sobre a origem
+	float forward;						//Distância do eixo pan ao eixo tilt, para a frente
+	float lateral;						//Distância da linha de visada ao eixo pan, para a esquerda
+	float sight;						//Distância da linha de visada ao eixo tilt, para cima
+	float panZero;						//Ângulo do eixo X apontando para +X em graus
+	float tiltZero;						//Ângulo do eixo Y com a visada na horizontal em graus
+
+public:
+	/**
+	 * Construtor
+	 *
+	 * panZero				Ângulo do eixo X apontando para +X em graus
+	 * tiltZero				Ângulo do eixo Y com a visada na horizontal em graus
+	 */
+	PanTilt(float panZero, float tiltZero);
+
+	/**
+	 * Define os offsets da montagem, na mesma unidade dos pontos
+	 *
+	 * height				Altura do eixo tilt sobre a origem
+	 * forward				Distância do eixo pan ao eixo tilt, para a frente
+	 * lateral				Distância da linha de visada ao eixo pan, para a esquerda
+	 * sight				Distância da linha de visada ao eixo tilt, para cima
+	 */
+	void setOffsets(float height, float forward, float lateral, float sight);
+
+	/**
+	 * Calcula os ângulos dos eixos para apontar para um ponto. Retorna false
+	 * se o ponto estiver perto demais para a linha de visada alcançá-lo
+	 *
+	 * x					Coordenada X do ponto
+	 * y					Coordenada Y do ponto
+	 * z					Coordenada Z do ponto
+	 * angles				Array onde o ângulo de cada eixo em graus será escrito
+	 */
+	bool pointAt(float x, float y, float z, float angles[N_AXIS]);
+};
+
+#endif /* PANTILT_H_ */
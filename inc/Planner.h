@@ -0,0 +1,330 @@
+/*
+ * Planner.h
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef PLANNER_H_
+#define PLANNER_H_
+
+#include "stm32f4xx_hal.h"
+
+//Quantidade de blocos na fila de movimentação (potência de 2)
+#define BLOCK_BUFFER_SIZE 16
+
+//Velocidade mínima nas junções e no final da fila em graus/s
+#define MINIMUM_PLANNER_SPEED 0.0f
+
+//No perfil em curva S a aceleração de pico é 1,5 vezes a média, então a média é
+//reduzida para que o pico respeite a aceleração configurada
+#define S_CURVE_ACCELERATION_FACTOR (2.0f/3.0f)
+
+//Taxa mínima de passos em passos/s, evita períodos longos demais no início e fim das rampas
+#define MINIMUM_STEP_RATE 120
+
+//Índices dos eixos
+#define X_AXIS 0
+#define Y_AXIS 1
+#define N_AXIS 2
+
+/**
+ * Bloco de movimentação planejado
+ */
+struct PlanBlock {
+	//Dados utilizados pelo gerador de passos
+	uint32_t steps[N_AXIS];			//Quantidade de passos de cada eixo
+	uint8_t direction[N_AXIS];		//Direção de cada eixo (CW ou CCW)
+	uint32_t stepEventCount;		//Quantidade de passos do eixo que mais se move
+	uint32_t nominalRate;			//Passos/s do eixo principal na velocidade nominal
+	uint32_t initialRate;			//Passos/s no início do bloco
+	uint32_t finalRate;				//Passos/s no final do bloco
+	uint32_t accelerateUntil;		//Passo em que termina a aceleração
+	uint32_t decelerateAfter;		//Passo a partir do qual começa a desaceleração
+	bool sCurve;					//True se o bloco usa perfil em curva S
+	uint32_t peakRate;				//Passos/s ao fim da aceleração
+	volatile bool busy;				//True se o bloco estiver em execução
+
+	//Ponto PVT: trajetória cúbica entre as posições e velocidades de cada
+	//eixo, percorrida no tempo pedido. Não tem perfil de velocidade
+	bool pvt;						//True se o bloco for um ponto PVT
+	float pvtDuration;				//Duração do trecho em s
+	float pvtEntryRate[N_AXIS];		//Taxa de cada eixo no início em passos/s, com sinal
+	float pvtExitRate[N_AXIS];		//Taxa de cada eixo no final em passos/s, com sinal
+
+	//Dados utilizados pelo planejador
+	float distance;					//Comprimento do movimento em graus
+	float acceleration;				//Aceleração ao longo do caminho em graus/s², limitada pelos eixos
+	float maxSpeed;					//Velocidade máxima ao longo do caminho pelos limites dos eixos em graus/s
+	float programmedSpeed;			//Velocidade pedida pelo comando em graus/s, sem override
+	float nominalSpeed;				//Velocidade nominal em graus/s
+	float entrySpeed;				//Velocidade de entrada planejada em graus/s
+	float maxJunctionSpeed;			//Velocidade máxima na junção pela geometria em graus/s
+	float maxEntrySpeed;			//Velocidade máxima permitida na junção em graus/s
+	float exitSpeed;				//Velocidade de saída usada no último cálculo do perfil em graus/s
+	float accelerationSteps;		//Aceleração do eixo principal em passos/s²
+	bool nominalLengthFlag;			//True se o bloco alcança a velocidade nominal partindo do repouso
+	bool recalculateFlag;			//True se o perfil do bloco precisa ser recalculado
+};
+
+class Planner {
+private:
+	PlanBlock blocks[BLOCK_BUFFER_SIZE];		//Fila de blocos
+	volatile uint8_t head;						//Próximo bloco a ser escrito
+	volatile uint8_t tail;						//Bloco em execução
+
+	int32_t position[N_AXIS];					//Posição ao fim do último bloco adicionado em passos
+	float stepsPerDegree[N_AXIS];				//Passos por grau de cada eixo
+	float maxSpeed[N_AXIS];						//Velocidade máxima de cada eixo em graus/s
+	float acceleration[N_AXIS];					//Aceleração média de cada eixo em graus/s²
+	bool sCurve;								//True para perfil em curva S, false para trapezoidal
+	float junctionDeviation;					//Desvio de junção em graus
+	float feedOverride;							//Fator aplicado às velocidades programadas
+
+	float previousUnitVector[N_AXIS];			//Direção do último bloco adicionado
+	float previousProgrammedSpeed;				//Velocidade programada do último bloco adicionado
+	float previousMaxSpeed;						//Velocidade máxima do último bloco adicionado
+	float previousPvtRate[N_AXIS];				//Taxa de cada eixo no último ponto PVT em passos/s
+
+	/**
+	 * Retorna o índice seguinte ao informado na fila
+	 */
+	static uint8_t nextIndex(uint8_t index);
+
+	/**
+	 * Retorna o índice anterior ao informado na fila
+	 */
+	static uint8_t previousIndex(uint8_t index);
+
+	/**
+	 * Retorna o maior valor ao longo de uma direção que respeita o limite de
+	 * cada eixo, ou seja, o limite do eixo mais restritivo nessa direção
+	 *
+	 * limits				Limite de cada eixo
+	 * unitVector			Direção do movimento, normalizada
+	 */
+	static float limitByAxis(const float limits[N_AXIS], const float unitVector[N_AXIS]);
+
+	/**
+	 * Calcula a maior velocidade com que se pode começar um trecho e ainda
+	 * conseguir chegar a velocidade final dentro da distância informada
+	 *
+	 * accel				Aceleração em graus/s² (negativa para desaceleração)
+	 * targetSpeed			Velocidade final em graus/s
+	 * distance				Distância disponível em graus
+	 */
+	static float maxAllowableSpeed(float accel, float targetSpeed, float distance);
+
+	/**
+	 * Calcula a distância em passos para ir de uma taxa de passos a outra
+	 *
+	 * initialRate			Taxa inicial em passos/s
+	 * targetRate			Taxa final em passos/s
+	 * accel				Aceleração em passos/s² (negativa para desaceleração)
+	 */
+	static float accelerationDistance(float initialRate, float targetRate, float accel);
+
+	/**
+	 * Calcula em que passo deve começar a desaceleração para um bloco que não
+	 * alcança a velocidade nominal
+	 *
+	 * initialRate			Taxa inicial em passos/s
+	 * finalRate			Taxa final em passos/s
+	 * accel				Aceleração em passos/s²
+	 * distance				Quantidade de passos do bloco
+	 */
+	static float intersectionDistance(float initialRate, float finalRate, float accel, float distance);
+
+	/**
+	 * Calcula o perfil trapezoidal de velocidade de um bloco. Retorna false se
+	 * o bloco já estiver em execução e não puder mais ser alterado
+	 *
+	 * block				Bloco a ser calculado
+	 * entrySpeed			Velocidade de entrada em graus/s
+	 * exitSpeed			Velocidade de saída em graus/s
+	 */
+	bool calculateTrapezoid(PlanBlock* block, float entrySpeed, float exitSpeed);
+
+	/**
+	 * Recalcula as velocidades de entrada e os perfis de todos os blocos da fila
+	 */
+	void recalculate();
+
+	/**
+	 * Percorre a fila do bloco mais novo para o mais antigo, garantindo que
+	 * cada bloco consiga desacelerar até a velocidade de entrada do seguinte
+	 */
+	void reversePass(uint8_t first);
+
+	/**
+	 * Percorre a fila do bloco mais antigo para o mais novo, garantindo que
+	 * cada bloco consiga acelerar até a velocidade de entrada do seguinte
+	 */
+	void forwardPass(uint8_t first);
+
+	/**
+	 * Recalcula os perfis dos blocos cujas velocidades de entrada ou saída
+	 * foram alteradas
+	 */
+	void recalculateTrapezoids(uint8_t first);
+
+public:
+	/**
+	 * Construtor
+	 *
+	 * stepsPerDegree		Passos por grau de cada eixo
+	 * maxFeedrate			Velocidade máxima de cada eixo em graus/min
+	 * acceleration			Aceleração de cada eixo em graus/s²
+	 * junctionDeviation	Desvio de junção em graus, define a velocidade nas curvas
+	 * sCurve				True para perfil em curva S (jerk limitado), false para trapezoidal
+	 */
+	Planner(const float stepsPerDegree[N_AXIS], const float maxFeedrate[N_AXIS],
+			const float acceleration[N_AXIS], float junctionDeviation, bool sCurve);
+
+	/**
+	 * Adiciona um movimento em linha à fila. Retorna false se a fila estiver
+	 * cheia
+	 *
+	 * target				Posição absoluta final de cada eixo em passos
+	 * feedrate				Velocidade ao longo do caminho em graus/min
+	 */
+	bool bufferLine(const int32_t target[N_AXIS], float feedrate);
+
+	/**
+	 * Adiciona um ponto PVT à fila. Os eixos seguem uma cúbica partindo da
+	 * posição e velocidade do ponto anterior, ou do repouso, até a posição
+	 * e velocidade pedidas. Retorna false se a fila estiver cheia
+	 *
+	 * target				Posição absoluta final de cada eixo em passos
+	 * velocity				Velocidade final de cada eixo em graus/s, com sinal
+	 * duration				Tempo para chegar ao ponto em s
+	 */
+	bool bufferPvt(const int32_t target[N_AXIS], const float velocity[N_AXIS], float duration);
+
+	/**
+	 * Define a posição atual sem movimentar os eixos. Só deve ser chamado com
+	 * a fila vazia
+	 *
+	 * position				Posição de cada eixo em passos
+	 */
+	void setPosition(const int32_t position[N_AXIS]);
+
+	/**
+	 * Retorna a posição ao fim do último bloco adicionado em passos
+	 *
+	 * position				Array onde a posição de cada eixo será escrita
+	 */
+	void getPosition(int32_t position[N_AXIS]);
+
+	/**
+	 * Descarta todos os blocos da fila. Só deve ser chamado com o gerador de
+	 * passos parado
+	 */
+	void clear();
+
+	/**
+	 * Faz o próximo ponto PVT partir do repouso, no início de uma sequência
+	 */
+	void resetPvt();
+
+	/**
+	 * Define a aceleração de todos os eixos utilizada nos próximos blocos
+	 *
+	 * acceleration			Aceleração em graus/s²
+	 */
+	void setAcceleration(float acceleration);
+
+	/**
+	 * Define a aceleração de um eixo utilizada nos próximos blocos
+	 *
+	 * axis					Índice do eixo
+	 * acceleration			Aceleração em graus/s²
+	 */
+	void setAcceleration(uint8_t axis, float acceleration);
+
+	/**
+	 * Define a velocidade máxima de um eixo utilizada nos próximos blocos
+	 *
+	 * axis					Índice do eixo
+	 * feedrate				Velocidade máxima em graus/min
+	 */
+	void setMaxFeedrate(uint8_t axis, float feedrate);
+
+	/**
+	 * Retorna os passos por grau de um eixo
+	 *
+	 * axis					Índice do eixo
+	 */
+	float getStepsPerDegree(uint8_t axis);
+
+	/**
+	 * Retorna a velocidade máxima de um eixo em graus/s
+	 *
+	 * axis					Índice do eixo
+	 */
+	float getMaxSpeed(uint8_t axis);
+
+	/**
+	 * Retorna a aceleração de um eixo em graus/s²
+	 *
+	 * axis					Índice do eixo
+	 */
+	float getAcceleration(uint8_t axis);
+
+	/**
+	 * Aplica um override às velocidades programadas de todos os blocos e
+	 * recalcula a fila. O bloco em execução só tem a velocidade de saída
+	 * limitada, o restante dele é replanejado pelo gerador de passos
+	 *
+	 * percent				Porcentagem da velocidade programada
+	 */
+	void setFeedOverride(uint16_t percent);
+
+	/**
+	 * Define a velocidade de saída do bloco em execução depois que o gerador de
+	 * passos replanejou o restante dele, e recalcula a fila a partir dela
+	 *
+	 * exitSpeed			Velocidade de saída em graus/s
+	 */
+	void setCurrentExitSpeed(float exitSpeed);
+
+	/**
+	 * Retorna o bloco mais antigo da fila ou NULL se a fila estiver vazia
+	 */
+	PlanBlock* currentBlock();
+
+	/**
+	 * Remove o bloco mais antigo da fila
+	 */
+	void discardCurrentBlock();
+
+	/**
+	 * Retorna true se a fila estiver cheia
+	 */
+	bool full();
+
+	/**
+	 * Retorna true se a fila estiver vazia
+	 */
+	bool empty();
+};
+
+#endif /* PLANNER_H_ */
@@ -32,29 +32,102 @@
 #include <stdarg.h>
 #include "CircularBuffer.h"
 
+//Tamanho do buffer de recepção, potência de 2
+#define SERIAL_RX_SIZE 128
+
+typedef CircularBuffer<uint8_t, SERIAL_RX_SIZE> SerialRxBuffer;
+
+//Modos de controle de fluxo
+#define SERIAL_FLOW_NONE 0
+#define SERIAL_FLOW_RTS_CTS 1			//CTS pelo hardware, RTS pelo nível do buffer de recepção
+#define SERIAL_FLOW_XON_XOFF 2			//Requer a transmissão por DMA
+
+//Níveis do buffer de recepção em que o host é mandado parar e voltar. Acima
+//de HIGH_WATER ainda cabem os bytes já a caminho quando o host é avisado
+#define SERIAL_FLOW_HIGH_WATER (SERIAL_RX_SIZE / 2)
+#define SERIAL_FLOW_LOW_WATER (SERIAL_RX_SIZE / 4)
+
+//Maior transferência da fila de transmissão com XON/XOFF, limita o atraso de
+//um XOFF que espera a transferência em andamento
+#define SERIAL_FLOW_CHUNK 16
+
+#define SERIAL_XON 0x11
+#define SERIAL_XOFF 0x13
+
 class Serial {
 	private:
 		UART_HandleTypeDef huart;				//Handler da porta serial
 		bool error;								//False se nenhum erro ocorreu
-		CircularBuffer<uint8_t>* rxBuffer;
+		SerialRxBuffer rxBuffer;				//Escrito pela interrupção, lido pelo loop principal
+		bool (*realtimeHandler)(uint8_t data);	//Tratamento de bytes em tempo real, NULL se nenhum
+
+		//Recepção por DMA circular
+		DMA_HandleTypeDef hdmaRx;				//Handler do stream de recepção
+		uint8_t* dmaBuffer;						//Buffer escrito pelo DMA, NULL sem DMA
+		uint16_t dmaSize;						//Tamanho de dmaBuffer
+		uint16_t dmaPosition;					//Próximo byte de dmaBuffer a ser lido
 
-	public:
 		/**
-		 * Construtor
+		 * Passa os bytes escritos pelo DMA desde a última chamada para o
+		 * buffer de recepção
+		 */
+		void receiveDma();
+
+		//Transmissão por DMA a partir de uma fila circular
+		DMA_HandleTypeDef hdmaTx;				//Handler do stream de transmissão
+		IRQn_Type txIrq;						//Interrupção do stream de transmissão
+		uint8_t* txBuffer;						//Fila de transmissão, NULL sem DMA
+		uint16_t txSize;						//Tamanho de txBuffer
+		volatile uint16_t txHead;				//Próximo byte livre da fila
+		volatile uint16_t txTail;				//Próximo byte a ser enviado
+		volatile uint16_t txLength;				//Bytes da transferência em andamento, 0 se parado
+		uint32_t txOverflows;					//Mensagens descartadas por fila cheia
+
+		/**
+		 * Inicia a transferência do trecho contínuo da fila a partir de txTail,
+		 * se o DMA estiver parado e houver bytes a enviar
+		 */
+		void startTransmit();
+
+		//Controle de fluxo
+		uint8_t flowControl;					//Modo, SERIAL_FLOW_*
+		GPIO_TypeDef* flowPort;					//Porta dos pinos CTS e RTS
+		uint16_t ctsPin;
+		uint16_t rtsPin;						//Saída, em nível baixo o host pode enviar
+		volatile bool rxThrottled;				//True se o host foi mandado parar
+		volatile bool txPaused;					//True se o host mandou XOFF
+		volatile uint8_t txFlowByte;			//XON ou XOFF a ser enviado, 0 se nenhum
+		volatile bool txFlowSending;			//True se a transferência em andamento é de txFlowBuffer
+		uint8_t txFlowBuffer;					//Origem do DMA para XON e XOFF
+
+		/**
+		 * Trata XON e XOFF do host e os comandos em tempo real. Retorna true se
+		 * o byte foi consumido e não deve entrar no buffer de recepção
 		 *
-		 * instance				Porta da serial
-		 * baud					Baud rate da serial
+		 * data					Byte recebido
 		 */
-		Serial(USART_TypeDef* instance, uint32_t baud);
+		bool filterByte(uint8_t data);
 
+		/**
+		 * Produtor: manda o host parar se o buffer de recepção passou de
+		 * SERIAL_FLOW_HIGH_WATER
+		 */
+		void throttleReception();
+
+		/**
+		 * Consumidor: libera o host se o buffer de recepção baixou até
+		 * SERIAL_FLOW_LOW_WATER
+		 */
+		void releaseReception();
+
+	public:
 		/**
 		 * Construtor
 		 *
-		 * instance				Instância da serial
+		 * instance				Porta da serial
 		 * baud					Baud rate da serial
-		 * bufferSize			Tamanho do buffer de recepção
 		 */
-		Serial(USART_TypeDef* instance, uint32_t baud, uint16_t bufferSize);
+		Serial(USART_TypeDef* instance, uint32_t baud);
 
 		/**
 		 * Destrutor
@@ -67,12 +140,94 @@ class Serial {
 		void interruptCallback();
 
 		/**
-		 * Envia bytes pela serial
+		 * Passa a recepção para um DMA circular. Os bytes são lidos do buffer
+		 * do DMA quando a linha fica ociosa e a cada metade dele, em vez de
+		 * uma interrupção por byte. USART1 e USART6 usam o mesmo stream e não
+		 * podem ter DMA ao mesmo tempo. Retorna false se o DMA não puder ser
+		 * habilitado, e a recepção continua por interrupção
+		 *
+		 * size					Tamanho do buffer do DMA
+		 */
+		bool enableDmaReception(uint16_t size);
+
+		/**
+		 * Interrupção do stream de recepção, repassada ao handler do DMA
+		 */
+		void rxDmaInterrupt();
+
+		/**
+		 * Callback do DMA de recepção, chamado a cada metade do buffer escrita
+		 */
+		void rxDmaCallback();
+
+		/**
+		 * Passa a transmissão para uma fila circular esvaziada por DMA. write,
+		 * print e println copiam os dados para a fila e retornam sem esperar
+		 * o envio. Retorna false se o DMA não puder ser habilitado, e a
+		 * transmissão continua bloqueante
+		 *
+		 * size					Tamanho da fila de transmissão
+		 */
+		bool enableDmaTransmission(uint16_t size);
+
+		/**
+		 * Habilita o controle de fluxo. Com SERIAL_FLOW_RTS_CTS o CTS vem do
+		 * hardware e o RTS sobe quando o buffer de recepção passa da metade
+		 * (USART1: CTS PA11 e RTS PA12, USART2: CTS PA0 e RTS PA1, a USART6
+		 * não tem os pinos). Com SERIAL_FLOW_XON_XOFF são enviados XOFF e XON
+		 * nos mesmos níveis e os recebidos pausam a transmissão, o que exige
+		 * enableDmaTransmission antes. Retorna false se o modo não puder ser
+		 * habilitado
+		 *
+		 * mode					SERIAL_FLOW_RTS_CTS ou SERIAL_FLOW_XON_XOFF
+		 */
+		bool enableFlowControl(uint8_t mode);
+
+		/**
+		 * Interrupção do stream de transmissão, repassada ao handler do DMA
+		 */
+		void txDmaInterrupt();
+
+		/**
+		 * Callback do DMA de transmissão, chamado ao fim de cada transferência
+		 */
+		void txDmaCallback();
+
+		/**
+		 * Retorna o número de bytes livres na fila de transmissão, 0 sem DMA
+		 */
+		size_t txFree();
+
+		/**
+		 * Retorna o número de mensagens descartadas por falta de espaço na fila
+		 * de transmissão
+		 */
+		uint32_t getTxOverflows();
+
+		/**
+		 * Retorna o número de bytes descartados por falta de espaço no buffer
+		 * de recepção
+		 */
+		uint32_t getRxOverflows();
+
+		/**
+		 * Define uma função chamada pela interrupção para cada byte recebido,
+		 * antes de ele entrar no buffer. Se ela retornar true o byte é
+		 * consumido e não entra no buffer
+		 *
+		 * handler				Função de tratamento, NULL para desabilitar
+		 */
+		void setRealtimeHandler(bool (*handler)(uint8_t data));
+
+		/**
+		 * Envia bytes pela serial. Com a transmissão por DMA os bytes vão para
+		 * a fila e o retorno é imediato; se não couberem inteiros nada é
+		 * enviado e retorna false
 		 *
 		 * data					Array com os dados a serem enviados
 		 * length				Quantidade de bytes do array data a serem enviados
 		 */
-		void write(char *data, uint16_t length);
+		bool write(char *data, uint16_t length);
 
 		/**
 		 * Envia uma string pela serial, ou seja, envia todos os bytes do array data,
@@ -100,12 +255,27 @@ class Serial {
 		size_t available();
 
 		/**
-		 * Lê do buffer de recepção o número de bytes especificado no array data
+		 * Lê do buffer de recepção até o número de bytes especificado no array
+		 * data. Retorna o número de bytes lidos
 		 *
 		 * data					O array para escrita dos dados
-		 * length				Quantidade de bytes a serem escritos no array
+		 * length				Quantidade máxima de bytes a serem escritos no array
+		 */
+		uint16_t read(uint8_t* data, uint16_t length);
+
+		/**
+		 * Retorna o trecho contínuo de bytes recebidos, direto no buffer de
+		 * recepção, para ser analisado sem cópia. Os bytes continuam no buffer
+		 * até consume
+		 */
+		SerialRxBuffer::Span readSpan();
+
+		/**
+		 * Libera do buffer de recepção os primeiros bytes do trecho de readSpan
+		 *
+		 * length				Quantidade de bytes já tratados
 		 */
-		void read(uint8_t* data, uint16_t length);
+		void consume(size_t length);
 
 		/**
 		 * Retorna o primeiro byte contido no buffer de recepção sem retirá-lo
@@ -0,0 +1,600 @@
+/*
+ * StepGenerator.h
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef STEPGENERATOR_H_
+#define STEPGENERATOR_H_
+
+#include "stm32f4xx_hal.h"
+
+#include "Planner.h"
+#include "Stepper.h"
+
+//Frequência de contagem do timer de passos em Hz
+#define STEP_TIMER_FREQUENCY 12000000UL
+
+//Quantidade de segmentos no buffer entre a preparação e a interrupção (potência de 2)
+#define SEGMENT_BUFFER_SIZE 8
+
+//Duração de cada segmento em s. O buffer cheio cobre SEGMENT_BUFFER_SIZE vezes
+//esse tempo, que é o quanto o loop principal pode atrasar sem parar os motores
+#define SEGMENT_TIME 0.01f
+
+//Menor período de passo em ticks do timer
+#define MINIMUM_STEP_PERIOD 2
+
+//Maior período de passo em ticks do timer, abaixo de UINT32_MAX
+#define MAXIMUM_STEP_PERIOD 4.0e9f
+
+//Modo de velocidade: taxas abaixo de VELOCITY_MIN_RATE (passos/s) param o eixo,
+//e um segmento esticado para caber um passo não passa de VELOCITY_MAX_SEGMENTS
+//vezes SEGMENT_TIME, para que M5 e o feed hold não esperem um segmento longo
+#define VELOCITY_MIN_RATE 1.0f
+#define VELOCITY_MAX_SEGMENTS 10
+
+//Suavização dos passos em taxas baixas. No nível n a interrupção roda 2^n
+//vezes por passo do eixo principal, e os passos dos outros eixos caem mais
+//perto do instante ideal. 0 desabilita
+#define MAX_SMOOTHING_LEVEL 3
+
+//Períodos de passo em ticks do timer a partir dos quais cada nível é usado
+#define SMOOTHING_LEVEL1_PERIOD (STEP_TIMER_FREQUENCY / 8000)
+#define SMOOTHING_LEVEL2_PERIOD (STEP_TIMER_FREQUENCY / 4000)
+#define SMOOTHING_LEVEL3_PERIOD (STEP_TIMER_FREQUENCY / 2000)
+
+//Limites do override de velocidade em %
+#define FEED_OVERRIDE_MIN 10
+#define FEED_OVERRIDE_MAX 200
+
+//Estados da execução
+#define STEP_STATE_CYCLE 0				//Executando a fila normalmente
+#define STEP_STATE_HOLD 1				//Feed hold, desacelerando ou parado
+
+//Retorno de stepEvent: bits 0 a N_AXIS-1 indicam os eixos que devem dar passo
+#define STEP_EVENT_DIRECTION 0x40		//Direções mudaram, devem ser aplicadas antes do próximo passo
+#define STEP_EVENT_IDLE 0x80			//Nenhum bloco para executar
+
+class StepWaveform;
+
+/**
+ * Dados de um bloco utilizados pela interrupção
+ */
+struct StepBlock {
+	uint32_t steps[N_AXIS];			//Passos de cada eixo multiplicados por 2^MAX_SMOOTHING_LEVEL
+	uint8_t direction[N_AXIS];		//Direção de cada eixo (CW ou CCW)
+	uint32_t stepEventCount;		//Passos do eixo principal multiplicados por 2^MAX_SMOOTHING_LEVEL
+};
+
+/**
+ * Trecho de um bloco com período de passo constante
+ */
+struct StepSegment {
+	uint32_t steps;					//Quantidade de eventos de passo do segmento
+	uint32_t period;				//Período entre os eventos em ticks do timer
+	uint8_t block;					//Índice do bloco em StepGenerator::blocks
+	uint8_t level;					//Nível de suavização, cada passo vale 2^level eventos
+};
+
+/**
+ * Período dos eventos de um segmento de duração SEGMENT_TIME
+ */
+struct StepPeriod {
+	uint32_t period;				//Período entre os eventos em ticks do timer
+	uint8_t level;					//Nível de suavização
+};
+
+/**
+ * Tabela de períodos indexada pela quantidade de passos do segmento
+ */
+template<uint32_t SIZE>
+struct StepPeriodTable {
+	StepPeriod entries[SIZE];
+};
+
+/**
+ * Retorna o nível de suavização para um período entre passos
+ *
+ * period				Período entre passos em ticks do timer
+ */
+constexpr uint8_t smoothingLevel(float period) {
+	uint8_t level = 0;
+	if (MAX_SMOOTHING_LEVEL >= 1 && period > SMOOTHING_LEVEL1_PERIOD) {
+		level = 1;
+	}
+	if (MAX_SMOOTHING_LEVEL >= 2 && period > SMOOTHING_LEVEL2_PERIOD) {
+		level = 2;
+	}
+	if (MAX_SMOOTHING_LEVEL >= 3 && period > SMOOTHING_LEVEL3_PERIOD) {
+		level = 3;
+	}
+	return level;
+}
+
+/**
+ * Gera em tempo de compilação a tabela de períodos para segmentos de 0 a
+ * SIZE - 1 passos. Declarada constexpr, a tabela fica na flash
+ */
+template<uint32_t SIZE>
+constexpr StepPeriodTable<SIZE> makeStepPeriodTable() {
+	StepPeriodTable<SIZE> table = {};
+
+	for (uint32_t steps = 1; steps < SIZE; steps++) {
+		float period = SEGMENT_TIME * STEP_TIMER_FREQUENCY / steps;
+		if (period < MINIMUM_STEP_PERIOD) {
+			period = MINIMUM_STEP_PERIOD;
+		}
+
+		uint8_t level = smoothingLevel(period);
+		table.entries[steps].period = (uint32_t) (period / (1 << level) + 0.5f);
+		table.entries[steps].level = level;
+	}
+
+	return table;
+}
+
+class StepGenerator {
+private:
+	TIM_HandleTypeDef htim;						//Handler do timer
+	bool error;									//False se nenhum erro ocorreu
+	Stepper* axis[N_AXIS];						//Motores de cada eixo
+
+	Planner* planner;							//Fila de blocos planejados
+	StepWaveform* waveform;						//Saída por DMA, NULL para saída pela interrupção
+	const StepPeriod* periodTable;				//Períodos tabelados por passos do segmento, NULL se nenhum
+	uint32_t periodTableSize;					//Quantidade de entradas em periodTable
+	volatile bool running;						//True se houver passos sendo gerados
+
+	//Buffer de segmentos. Cada bloco com segmentos no buffer ocupa uma posição
+	//em blocks, então SEGMENT_BUFFER_SIZE - 1 posições são suficientes
+	StepBlock blocks[SEGMENT_BUFFER_SIZE - 1];	//Blocos referenciados pelos segmentos
+	StepSegment segments[SEGMENT_BUFFER_SIZE];	//Fila de segmentos
+	volatile uint8_t segmentHead;				//Próximo segmento a ser escrito
+	volatile uint8_t segmentTail;				//Segmento em execução
+
+	//Estado da interrupção
+	StepSegment* segment;						//Segmento em execução, NULL se nenhum
+	StepBlock* block;							//Bloco do segmento em execução
+	uint8_t blockIndex;							//Índice do bloco em execução
+	uint32_t segmentSteps;						//Eventos de passo restantes no segmento
+	uint32_t delta[N_AXIS];						//Incremento dos contadores de Bresenham por evento
+	int32_t counter[N_AXIS];					//Contadores do algoritmo de Bresenham
+	int8_t increment[N_AXIS];					//Incremento da posição a cada passo (+1 ou -1)
+	uint8_t direction[N_AXIS];					//Direção atual dos pinos de cada eixo
+	volatile int32_t position[N_AXIS];			//Posição real dos eixos em passos
+	uint32_t stepPeriod;						//Período do passo atual em ticks do timer
+
+	//Estado da preparação
+	PlanBlock* prepBlock;						//Bloco sendo dividido em segmentos, NULL se nenhum
+	uint8_t prepBlockIndex;						//Índice de prepBlock em blocks
+	uint32_t prepSteps;							//Passos do bloco já colocados em segmentos
+	float prepTime;								//Tempo desde o início do perfil em s
+	float prepPosition;							//Posição no bloco ao fim do último segmento em passos
+	float prepSpeed;							//Velocidade ao fim do último bloco preparado em graus/s
+	bool replanEntry;							//True se o próximo bloco deve partir de prepSpeed
+
+	//Perfil de velocidade do trecho em preparação. Normalmente é o perfil
+	//planejado do bloco inteiro, mas é refeito a partir da posição atual no
+	//feed hold, na retomada e quando o override muda
+	float profileStart;							//Posição no bloco em que o perfil começa em passos
+	float profileEnd;							//Posição no bloco em que o perfil termina em passos
+	float initialRate;							//Taxa no início do perfil em passos/s
+	float peakRate;								//Taxa ao fim da primeira rampa em passos/s
+	float finalRate;							//Taxa no final do perfil em passos/s
+	float accelerationSteps;					//Passos da primeira rampa
+	float cruiseSteps;							//Passos do cruzeiro
+	float accelerationTime;						//Duração da primeira rampa em s
+	float cruiseTime;							//Duração do cruzeiro em s
+	float decelerationTime;						//Duração da desaceleração em s
+
+	//Comandos em tempo real, escritos pela interrupção da serial
+	volatile bool holdRequest;					//Feed hold pedido
+	volatile bool resumeRequest;				//Retomada pedida
+	volatile uint16_t feedOverride;				//Override pedido em %
+	uint16_t appliedOverride;					//Override aplicado ao planejador em %
+	uint8_t state;								//Estado da execução
+
+	//Parada imediata pelos fins de curso
+	volatile bool stopped;						//True se a geração de passos foi interrompida
+	volatile uint8_t armedEndstops;				//Eixos cujo fim de curso interrompe o movimento
+	volatile uint8_t triggeredEndstops;			//Eixos cujo fim de curso foi acionado
+	volatile uint8_t hardLimits;				//Eixos cujo fim de curso fora do homing gera alarme
+	volatile bool alarm;						//True se um limite foi atingido, a posição não é confiável
+
+	//Modo de velocidade: cada eixo gira com a taxa pedida até receber outra,
+	//sem blocos do planejador
+	bool velocityMode;							//True enquanto os segmentos vêm do modo de velocidade
+	float velocityTarget[N_AXIS];				//Taxa pedida de cada eixo em passos/s, com sinal
+	float velocityRate[N_AXIS];					//Taxa atual de cada eixo em passos/s, com sinal
+	float velocityAcceleration[N_AXIS];			//Aceleração de cada eixo em passos/s²
+	float velocityPosition[N_AXIS];				//Passos percorridos desde o início do modo, com fração
+	int32_t velocitySteps[N_AXIS];				//Passos já colocados em segmentos desde o início do modo
+
+	//Pontos PVT: a cúbica do bloco é percorrida com o tempo escalado, que
+	//desacelera até zero no feed hold
+	float pvtTime;								//Tempo da trajetória desde o início do ponto em s
+	float pvtScale;								//Fator do tempo da trajetória, 1 fora do feed hold
+	int32_t pvtSteps[N_AXIS];					//Passos do ponto já colocados em segmentos, com sinal
+	PlanBlock pvtStop;							//Desaceleração depois do último ponto, fora da fila do planejador
+
+	/**
+	 * Retorna o índice seguinte ao informado no buffer de segmentos
+	 */
+	static uint8_t nextSegment(uint8_t index);
+
+	/**
+	 * Começa a dividir em segmentos o bloco mais antigo do planejador.
+	 * Retorna false se o planejador estiver vazio
+	 */
+	bool loadPrepBlock();
+
+	/**
+	 * Prepara segmentos do modo de velocidade, acelerando cada eixo até a
+	 * taxa pedida. Sai do modo quando todos os eixos param sem nova taxa
+	 */
+	void prepareVelocity();
+
+	/**
+	 * Prepara um segmento de duração SEGMENT_TIME de uma sequência de pontos
+	 * PVT, passando para o ponto seguinte quando o atual termina. Retorna
+	 * false se os eixos estiverem parados pelo feed hold
+	 */
+	bool preparePvtSegment();
+
+	/**
+	 * Prepara em pvtStop a desaceleração dos eixos quando a fila esvazia no
+	 * meio de uma sequência PVT. Retorna false se os eixos já estiverem parados
+	 *
+	 * rate					Taxa de cada eixo no último ponto em passos/s, com sinal
+	 */
+	bool loadPvtStop(const float rate[N_AXIS]);
+
+	/**
+	 * Retorna a posição de um eixo na cúbica do ponto PVT em preparação, em
+	 * passos com sinal desde o início do ponto
+	 *
+	 * axis					Índice do eixo
+	 * time					Tempo desde o início do ponto em s
+	 */
+	float pvtPosition(uint8_t axis, float time);
+
+	/**
+	 * Retorna a taxa de um eixo na cúbica do ponto PVT em preparação em
+	 * passos/s, com sinal
+	 *
+	 * axis					Índice do eixo
+	 * time					Tempo desde o início do ponto em s
+	 */
+	float pvtRate(uint8_t axis, float time);
+
+	/**
+	 * Coloca no buffer um segmento com o próprio bloco, usado quando os eixos
+	 * podem mudar de direção a cada segmento
+	 *
+	 * steps				Passos de cada eixo no segmento, com sinal
+	 * duration				Duração do segmento em s
+	 * fullSegment			True se a duração for exatamente SEGMENT_TIME
+	 */
+	void queueSegment(const int32_t steps[N_AXIS], float duration, bool fullSegment);
+
+	/**
+	 * Retorna o período e o nível de suavização de um segmento
+	 *
+	 * steps				Passos do eixo principal no segmento
+	 * duration				Duração do segmento em s
+	 * fullSegment			True se a duração for exatamente SEGMENT_TIME
+	 */
+	StepPeriod segmentTiming(uint32_t steps, float duration, bool fullSegment);
+
+	/**
+	 * Define o perfil de velocidade a partir das taxas e dos passos de cada fase
+	 *
+	 * initial				Taxa no início em passos/s
+	 * peak					Taxa ao fim da primeira rampa em passos/s
+	 * final				Taxa no final em passos/s
+	 * acceleration			Passos da primeira rampa
+	 * cruise				Passos do cruzeiro
+	 */
+	void setProfile(float initial, float peak, float final, float acceleration, float cruise);
+
+	/**
+	 * Refaz o perfil do bloco em preparação da posição atual até profileEnd.
+	 * Retorna a taxa que de fato é alcançada no final, que pode ser diferente
+	 * da pedida se não houver distância suficiente
+	 *
+	 * initial				Taxa atual em passos/s
+	 * nominal				Taxa de cruzeiro em passos/s
+	 * final				Taxa desejada no final em passos/s
+	 */
+	float replan(float initial, float nominal, float final);
+
+	/**
+	 * Refaz o perfil do bloco em preparação até o fim dele, terminando na
+	 * velocidade de saída planejada. Se ela não puder ser alcançada, o
+	 * planejador é avisado da velocidade real
+	 *
+	 * initial				Taxa atual em passos/s
+	 */
+	void replanToExit(float initial);
+
+	/**
+	 * Refaz o perfil do bloco em preparação para parar o mais rápido possível
+	 * partindo da taxa atual
+	 *
+	 * initial				Taxa atual em passos/s
+	 */
+	void replanHold(float initial);
+
+	/**
+	 * Retorna quantos passos do bloco em preparação já foram dados em um
+	 * instante, de acordo com o perfil de velocidade
+	 *
+	 * time					Tempo desde o início do perfil em s
+	 */
+	float profilePosition(float time);
+
+	/**
+	 * Retorna a taxa de passos do bloco em preparação em um instante
+	 *
+	 * time					Tempo desde o início do perfil em s
+	 */
+	float profileRate(float time);
+
+	/**
+	 * Retorna a distância percorrida em uma rampa
+	 *
+	 * time					Tempo desde o início da rampa em s
+	 * duration				Duração da rampa em s
+	 * startRate			Taxa no início da rampa em passos/s
+	 * endRate				Taxa no final da rampa em passos/s
+	 * sCurve				True se a rampa é em curva S
+	 */
+	static float rampPosition(float time, float duration, float startRate, float endRate, bool sCurve);
+
+	/**
+	 * Retorna a taxa em um instante de uma rampa
+	 *
+	 * time					Tempo desde o início da rampa em s
+	 * duration				Duração da rampa em s
+	 * startRate			Taxa no início da rampa em passos/s
+	 * endRate				Taxa no final da rampa em passos/s
+	 * sCurve				True se a rampa é em curva S
+	 */
+	static float rampRate(float time, float duration, float startRate, float endRate, bool sCurve);
+
+public:
+	/**
+	 * Construtor
+	 *
+	 * instance				Timer de 32 bits a ser utilizado (TIM2 ou TIM5)
+	 * planner				Fila de blocos a ser executada
+	 * xAxis				Motor do eixo X
+	 * yAxis				Motor do eixo Y
+	 */
+	StepGenerator(TIM_TypeDef* instance, Planner* planner, Stepper* xAxis, Stepper* yAxis);
+
+	/**
+	 * Destrutor
+	 */
+	~StepGenerator();
+
+	/**
+	 * Divide os blocos do planejador em segmentos até encher o buffer. Não
+	 * usa a interrupção, deve ser chamado pelo loop principal
+	 */
+	void prepare();
+
+	/**
+	 * Prepara segmentos e inicia a execução caso o timer esteja parado. Deve
+	 * ser chamado após adicionar blocos ao planejador e periodicamente
+	 * enquanto houver movimento
+	 */
+	void wakeUp();
+
+	/**
+	 * Retorna true se houver algum bloco em execução ou na fila
+	 */
+	bool busy();
+
+	/**
+	 * Aguarda até que todos os blocos da fila sejam executados
+	 */
+	void synchronize();
+
+	/**
+	 * Pede a parada dos eixos com desaceleração controlada, mantendo a fila.
+	 * Pode ser chamado pela interrupção da serial
+	 */
+	void feedHold();
+
+	/**
+	 * Retoma a execução após um feed hold. Pode ser chamado pela interrupção
+	 * da serial
+	 */
+	void cycleStart();
+
+	/**
+	 * Define o override de velocidade, aplicado inclusive ao bloco em execução.
+	 * Pode ser chamado pela interrupção da serial
+	 *
+	 * percent				Porcentagem da velocidade programada, de FEED_OVERRIDE_MIN a FEED_OVERRIDE_MAX
+	 */
+	void setFeedOverride(uint16_t percent);
+
+	/**
+	 * Retorna o override de velocidade em %
+	 */
+	uint16_t getFeedOverride();
+
+	/**
+	 * Retorna true se a execução estiver em feed hold
+	 */
+	bool isHeld();
+
+	/**
+	 * Define a velocidade de um eixo no modo de velocidade. O eixo acelera
+	 * até ela e gira até receber outra, zero para e sai do modo quando
+	 * todos os eixos estiverem parados. O modo começa quando a fila do
+	 * planejador termina. Velocidades abaixo de VELOCITY_MIN_RATE passos/s
+	 * são tratadas como zero
+	 *
+	 * axis					Índice do eixo
+	 * speed				Velocidade em graus/s, negativa para girar ao contrário
+	 */
+	void setVelocity(uint8_t axis, float speed);
+
+	/**
+	 * Retorna true se algum eixo estiver girando ou com velocidade pedida
+	 * no modo de velocidade
+	 */
+	bool velocityActive();
+
+	/**
+	 * Interrompe a geração de passos imediatamente, sem desaceleração. A
+	 * posição continua válida, mas a fila só volta a ser executada depois
+	 * de reset(). Pode ser chamado por interrupções
+	 */
+	void stop();
+
+	/**
+	 * Retorna true se a geração de passos foi interrompida por stop()
+	 */
+	bool isStopped();
+
+	/**
+	 * Descarta os segmentos e os blocos do planejador e volta a aceitar
+	 * movimentos a partir da posição real dos eixos
+	 */
+	void reset();
+
+	/**
+	 * Define os eixos cujos fins de curso interrompem o movimento e limpa os
+	 * acionamentos anteriores
+	 *
+	 * axes					Um bit por eixo
+	 */
+	void armEndstops(uint8_t axes);
+
+	/**
+	 * Informa o acionamento do fim de curso de um eixo. Chamado pela
+	 * interrupção do pino, para a geração de passos se o eixo estiver armado
+	 *
+	 * axis					Índice do eixo
+	 */
+	void endstopEvent(uint8_t axis);
+
+	/**
+	 * Retorna os eixos armados cujo fim de curso foi acionado, um bit por eixo
+	 */
+	uint8_t getTriggeredEndstops();
+
+	/**
+	 * Define os eixos com limite físico. Fora do homing, o acionamento do fim
+	 * de curso de um deles descarta inclusive os passos já calculados e
+	 * coloca o gerador em alarme
+	 *
+	 * axes					Um bit por eixo
+	 */
+	void setHardLimits(uint8_t axes);
+
+	/**
+	 * Retorna true se o gerador estiver em alarme por um limite físico
+	 */
+	bool inAlarm();
+
+	/**
+	 * Sai do alarme descartando a fila, como em reset(). A posição continua
+	 * a contada em passos, que pode ter sido perdida na parada
+	 */
+	void clearAlarm();
+
+	/**
+	 * Retorna a posição real dos eixos em passos
+	 *
+	 * position				Array onde a posição de cada eixo será escrita
+	 */
+	void getPosition(int32_t position[N_AXIS]);
+
+	/**
+	 * Define a posição real dos eixos sem movimentá-los. Só deve ser chamado
+	 * com os motores parados
+	 *
+	 * position				Posição de cada eixo em passos
+	 */
+	void setPosition(const int32_t position[N_AXIS]);
+
+	/**
+	 * Usa a saída por DMA no lugar da interrupção do timer
+	 *
+	 * waveform				Gerador de forma de onda que consome os eventos de passo
+	 */
+	void setWaveform(StepWaveform* waveform);
+
+	/**
+	 * Define a tabela de períodos usada para os segmentos de duração
+	 * SEGMENT_TIME. Segmentos fora da tabela têm o período calculado
+	 *
+	 * table				Tabela gerada por makeStepPeriodTable
+	 * size					Quantidade de entradas da tabela
+	 */
+	void setPeriodTable(const StepPeriod* table, uint32_t size);
+
+	/**
+	 * Avança um evento de passo do segmento atual. Retorna os eixos que devem dar
+	 * passo (um bit por eixo) e as flags STEP_EVENT_DIRECTION e STEP_EVENT_IDLE.
+	 * Quando as direções mudam, o evento não tem passos, garantindo um período
+	 * inteiro entre a mudança de direção e o passo anterior e o seguinte
+	 */
+	uint8_t stepEvent();
+
+	/**
+	 * Retorna o período até o próximo evento de passo em ticks de STEP_TIMER_FREQUENCY
+	 */
+	uint32_t getStepPeriod();
+
+	/**
+	 * Retorna a direção atual de um eixo (CW ou CCW)
+	 *
+	 * axis					Índice do eixo
+	 */
+	uint8_t getDirection(uint8_t axis);
+
+	/**
+	 * Retorna o motor de um eixo
+	 *
+	 * axis					Índice do eixo
+	 */
+	Stepper* getAxis(uint8_t axis);
+
+	/**
+	 * Callback da interrupção do timer
+	 */
+	void interruptCallback();
+
+	/**
+	 * Retorna true se houver algum erro
+	 */
+	bool getError();
+};
+
+#endif /* STEPGENERATOR_H_ */
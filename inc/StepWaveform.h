@@ -0,0 +1,124 @@
+/*
+ * StepWaveform.h
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef STEPWAVEFORM_H_
+#define STEPWAVEFORM_H_
+
+#include "stm32f4xx_hal.h"
+
+#include "StepGenerator.h"
+
+//Frequência de atualização dos pinos em Hz, a taxa máxima por eixo é a metade
+#define WAVEFORM_FREQUENCY 400000UL
+
+//Duração de uma atualização em ticks de STEP_TIMER_FREQUENCY
+#define WAVEFORM_TICK (STEP_TIMER_FREQUENCY / WAVEFORM_FREQUENCY)
+
+//Quantidade de palavras BSRR por porta no buffer circular (par)
+#define WAVEFORM_BUFFER_SIZE 512
+
+//Portas atendidas pelo DMA: GPIOA pelo canal 1 e GPIOB pelo update do TIM1
+#define WAVEFORM_PORTS 2
+
+/**
+ * Gera os sinais de passo e direção por DMA: a forma de onda dos dois eixos é
+ * calculada antecipadamente em palavras para os registradores BSRR, e um timer
+ * dispara o DMA que as escreve nas portas, sem a CPU em cada borda
+ */
+class StepWaveform {
+private:
+	TIM_HandleTypeDef htim;									//Timer que dispara o DMA
+	DMA_HandleTypeDef hdma[WAVEFORM_PORTS];					//Um stream por porta
+	GPIO_TypeDef* ports[WAVEFORM_PORTS];					//Portas escritas pelo DMA
+	uint32_t buffer[WAVEFORM_PORTS][WAVEFORM_BUFFER_SIZE];	//Palavras BSRR de cada porta
+	bool error;												//False se nenhum erro ocorreu
+	bool started;											//True se o DMA estiver rodando
+
+	StepGenerator* generator;								//Origem dos eventos de passo
+	uint8_t stepPort[N_AXIS];								//Índice da porta do pino de passo
+	uint32_t stepPin[N_AXIS];								//Máscara do pino de passo
+	uint8_t dirPort[N_AXIS];								//Índice da porta do pino de direção
+	uint32_t dirPin[N_AXIS];								//Máscara do pino de direção
+
+	int32_t timeToEvent;									//Ticks do timer de passos até o próximo evento
+	bool pendingReset;										//True se o tick seguinte deve abaixar os passos
+	volatile uint8_t idleHalves;							//Metades seguidas do buffer sem eventos
+
+	/**
+	 * Retorna o índice da porta no buffer ou WAVEFORM_PORTS se a porta não for
+	 * atendida pelo DMA
+	 */
+	uint8_t portIndex(GPIO_TypeDef* port);
+
+public:
+	/**
+	 * Construtor
+	 *
+	 * instance				Timer que dispara o DMA (TIM1)
+	 * generator			Gerador de passos que fornece os eventos
+	 */
+	StepWaveform(TIM_TypeDef* instance, StepGenerator* generator);
+
+	/**
+	 * Destrutor
+	 */
+	~StepWaveform();
+
+	/**
+	 * Inicia o timer e o DMA caso ainda não estejam rodando
+	 */
+	void start();
+
+	/**
+	 * Retorna true enquanto ainda houver passos no buffer a serem escritos
+	 */
+	bool playing();
+
+	/**
+	 * Descarta os passos já calculados que ainda não foram escritos nas
+	 * portas, mantendo os pinos de passo em nível baixo. Pode ser chamado
+	 * por interrupções de prioridade maior que a do DMA
+	 */
+	void abort();
+
+	/**
+	 * Calcula metade do buffer a partir dos eventos do gerador de passos
+	 *
+	 * offset				Primeira posição a ser calculada
+	 */
+	void render(uint32_t offset);
+
+	/**
+	 * Callback da interrupção do DMA
+	 */
+	void interruptCallback();
+
+	/**
+	 * Retorna true se houver algum erro
+	 */
+	bool getError();
+};
+
+#endif /* STEPWAVEFORM_H_ */
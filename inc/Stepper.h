@@ -40,6 +40,13 @@ private:
     DigitalOut* dirPin;
     DigitalOut* enablePin;
 
+    GPIO_TypeDef* stepPort;
+    uint32_t stepPinNumber;
+    GPIO_TypeDef* dirPort;
+    uint32_t dirPinNumber;
+    TIM_HandleTypeDef pulseTimer;		//Timer que gera o pulso de passo em hardware
+    bool pulseTimerEnabled;				//True se o passo for gerado pelo timer
+
 public:
     //Recebe o pino de passo, direção, habilitação e se é para inverter o sentido do motor
     Stepper(
@@ -65,6 +72,10 @@ public:
 
     ~Stepper();
 
+    //Passa a gerar o pulso de passo em hardware, com um timer em modo de pulso único
+    //ligado ao pino de passo. Retorna false se o timer não puder ser utilizado
+    bool setPulseTimer(TIM_TypeDef* instance, uint32_t channel, uint32_t alternate, uint32_t pulseWidthNs);
+
     //Executa um passo na direção definida
     void step();
 
@@ -85,6 +96,15 @@ public:
 
     //Retorna verdadeiro se o motor estiver habilitado
     bool isEnabled();
+
+    //Retornam a porta e o pino de passo e de direção, para escrita direta no BSRR
+    GPIO_TypeDef* getStepPort();
+    uint32_t getStepPin();
+    GPIO_TypeDef* getDirPort();
+    uint32_t getDirPin();
+
+    //Retorna o nível lógico do pino de direção para a direção informada
+    bool directionLevel(uint8_t dir);
 };
 
 #endif /* STEPPER_H_ */
@@ -0,0 +1,211 @@
+/*
+ * Arc.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <Arc.h>
+
+#include <cmath>
+
+#include "FastMath.h"
+
+/**
+ * Construtor para arcos definidos pelo centro (I/J)
+ *
+ * origin				Ponto inicial em passos
+ * target				Ponto final em passos
+ * i					Distância em X do ponto inicial ao centro em passos
+ * j					Distância em Y do ponto inicial ao centro em passos
+ * clockwise			True para sentido horário (G2)
+ * tolerance			Erro máximo entre a corda e o arco em passos
+ */
+Arc::Arc(const int32_t origin[N_AXIS], const int32_t target[N_AXIS], float i, float j, bool clockwise, float tolerance) {
+	this->clockwise = clockwise;
+	for (uint8_t a = 0; a < N_AXIS; a++) {
+		this->target[a] = target[a];
+	}
+
+	init(origin, i, j, tolerance);
+}
+
+/**
+ * Construtor para arcos definidos pelo raio (R). Raio negativo escolhe o
+ * arco maior que meia volta
+ *
+ * origin				Ponto inicial em passos
+ * target				Ponto final em passos
+ * r					Raio em passos
+ * clockwise			True para sentido horário (G2)
+ * tolerance			Erro máximo entre a corda e o arco em passos
+ */
+Arc::Arc(const int32_t origin[N_AXIS], const int32_t target[N_AXIS], float r, bool clockwise, float tolerance) {
+	this->clockwise = clockwise;
+	for (uint8_t a = 0; a < N_AXIS; a++) {
+		this->target[a] = target[a];
+	}
+
+	float x = (float) (target[X_AXIS] - origin[X_AXIS]);
+	float y = (float) (target[Y_AXIS] - origin[Y_AXIS]);
+
+	//O centro fica na mediatriz da corda, a uma distância h do meio dela
+	float h2 = 4.0f * r * r - x * x - y * y;
+	if ((x == 0.0f && y == 0.0f) || h2 < 0.0f) {
+		//Raio menor que meia corda ou círculo completo, que não é definido por R
+		error = true;
+		segments = 0;
+		segment = 0;
+		return;
+	}
+
+	float h = -fastSqrt(h2) / fastSqrt(x * x + y * y);
+	if (!clockwise) {
+		h = -h;
+	}
+	if (r < 0.0f) {
+		h = -h;
+	}
+
+	init(origin, 0.5f * (x - y * h), 0.5f * (y + x * h), tolerance);
+}
+
+/**
+ * Calcula o ângulo e a quantidade de segmentos a partir do centro
+ *
+ * origin				Ponto inicial em passos
+ * i					Distância em X do ponto inicial ao centro em passos
+ * j					Distância em Y do ponto inicial ao centro em passos
+ * tolerance			Erro máximo entre a corda e o arco em passos
+ */
+void Arc::init(const int32_t origin[N_AXIS], float i, float j, float tolerance) {
+	error = true;
+	segments = 0;
+	segment = 0;
+
+	//Vetores do centro até o início e até o final
+	float rx = -i;
+	float ry = -j;
+	float tx = (float) target[X_AXIS] - ((float) origin[X_AXIS] + i);
+	float ty = (float) target[Y_AXIS] - ((float) origin[Y_AXIS] + j);
+
+	float r = fastSqrt(rx * rx + ry * ry);
+	if (r < 0.5f) {
+		return;
+	}
+
+	//Os dois raios precisam ser iguais, a menos do arredondamento para passos
+	float rt = fastSqrt(tx * tx + ty * ty);
+	if (fabsf(rt - r) > 1.0f && fabsf(rt - r) > ARC_RADIUS_ERROR * r) {
+		return;
+	}
+
+	//Ângulo percorrido, no sentido pedido. Pontos iguais formam um círculo completo
+	float angle = fastAtan2(rx * ty - ry * tx, rx * tx + ry * ty);
+	if (clockwise) {
+		if (angle >= 0.0f) {
+			angle -= 2.0f * (float) M_PI;
+		}
+	} else {
+		if (angle <= 0.0f) {
+			angle += 2.0f * (float) M_PI;
+		}
+	}
+
+	//Segmentos cuja flecha é igual à tolerância
+	if (tolerance > r) {
+		tolerance = r;
+	}
+	float chord = 2.0f * fastSqrt(tolerance * (2.0f * r - tolerance));
+	segments = (uint32_t) floorf(fabsf(angle) * r / chord);
+	if (segments < 1) {
+		segments = 1;
+	}
+
+	theta = angle / (float) segments;
+	float c, s;
+	fastSinCos(theta, &s, &c);
+	cosTheta = (int32_t) lroundf(c * (float) (1UL << ARC_ROTATION_BITS));
+	sinTheta = (int32_t) lroundf(s * (float) (1UL << ARC_ROTATION_BITS));
+
+	//Centro e raio em ponto fixo, a partir daqui só a correção usa float
+	center[X_AXIS] = origin[X_AXIS] * (1 << ARC_FRACTION_BITS) + lroundf(i * (1 << ARC_FRACTION_BITS));
+	center[Y_AXIS] = origin[Y_AXIS] * (1 << ARC_FRACTION_BITS) + lroundf(j * (1 << ARC_FRACTION_BITS));
+	for (uint8_t a = 0; a < N_AXIS; a++) {
+		start[a] = origin[a] * (1 << ARC_FRACTION_BITS) - center[a];
+		radius[a] = start[a];
+	}
+
+	error = false;
+}
+
+/**
+ * Calcula o final do próximo segmento. O último segmento termina
+ * exatamente no ponto final
+ *
+ * point				Array onde o ponto em passos será escrito
+ *
+ * Retorna false quando não houver mais segmentos
+ */
+bool Arc::next(int32_t point[N_AXIS]) {
+	if (error || segment >= segments) {
+		return false;
+	}
+
+	segment++;
+
+	if (segment == segments) {
+		for (uint8_t a = 0; a < N_AXIS; a++) {
+			point[a] = target[a];
+		}
+		return true;
+	}
+
+	if (segment % ARC_CORRECTION == 0) {
+		//Corrige o erro acumulado girando o vetor inicial pelo ângulo total
+		float c, s;
+		fastSinCos(theta * (float) segment, &s, &c);
+		int32_t x = lroundf((float) start[X_AXIS] * c - (float) start[Y_AXIS] * s);
+		int32_t y = lroundf((float) start[X_AXIS] * s + (float) start[Y_AXIS] * c);
+		radius[X_AXIS] = x;
+		radius[Y_AXIS] = y;
+	} else {
+		//Rotação incremental em ponto fixo
+		int64_t x = (int64_t) radius[X_AXIS] * cosTheta - (int64_t) radius[Y_AXIS] * sinTheta;
+		int64_t y = (int64_t) radius[X_AXIS] * sinTheta + (int64_t) radius[Y_AXIS] * cosTheta;
+		radius[X_AXIS] = (int32_t) ((x + (1LL << (ARC_ROTATION_BITS - 1))) >> ARC_ROTATION_BITS);
+		radius[Y_AXIS] = (int32_t) ((y + (1LL << (ARC_ROTATION_BITS - 1))) >> ARC_ROTATION_BITS);
+	}
+
+	//Arredonda para o passo mais próximo
+	for (uint8_t a = 0; a < N_AXIS; a++) {
+		point[a] = (center[a] + radius[a] + (1 << (ARC_FRACTION_BITS - 1))) >> ARC_FRACTION_BITS;
+	}
+
+	return true;
+}
+
+/**
+ * Retorna true se houver algum erro
+ */
+bool Arc::getError() {
+	return error;
+}
@@ -0,0 +1,252 @@
+/*
+ * DigitalIn.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <DigitalIn.h>
+
+#define EXTI_LINES 16
+
+DigitalIn* extiHandlers[EXTI_LINES] = {0};
+
+/**
+ * Construtor
+ *
+ * port					Porta que contém o pino a ser inicializado
+ * pin					Número do pino
+ * pull					Resistor interno (GPIO_NOPULL, GPIO_PULLUP ou GPIO_PULLDOWN)
+ *
+ */
+DigitalIn::DigitalIn(GPIO_TypeDef* port, uint32_t pin, uint32_t pull) {
+	error = true;
+
+	this->port = port;
+	this->pin = pin;
+	handler = NULL;
+
+	config.Pin = this->pin;
+	config.Mode = GPIO_MODE_INPUT;
+	config.Pull = pull;
+	config.Speed = GPIO_SPEED_FREQ_LOW;
+
+	//Habilita o clock para a porta correta
+	if (this->port == GPIOA) {
+		__HAL_RCC_GPIOA_CLK_ENABLE();
+	} else if (this->port == GPIOB) {
+		__HAL_RCC_GPIOB_CLK_ENABLE();
+	} else if (this->port == GPIOC) {
+		__HAL_RCC_GPIOC_CLK_ENABLE();
+	} else if (this->port == GPIOD) {
+		__HAL_RCC_GPIOD_CLK_ENABLE();
+	} else if (this->port == GPIOH) {
+		__HAL_RCC_GPIOH_CLK_ENABLE();
+	} else {
+		return;
+	}
+
+	//Inicializa o pino
+	HAL_GPIO_Init(this->port, &config);
+
+	error = false;
+}
+
+/**
+ * Destrutor
+ */
+DigitalIn::~DigitalIn() {
+	if (!error) {
+		disableInterrupt();
+		HAL_GPIO_DeInit(this->port, this->pin);
+		error = true;
+	}
+}
+
+/**
+ * Retorna false se nível lógico baixo ou true se nível lógico alto na entrada.
+ *
+ */
+bool DigitalIn::read() {
+	if (!error) {
+		if (HAL_GPIO_ReadPin(this->port, this->pin)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Habilita a interrupção do pino pela EXTI. Cada linha da EXTI atende um
+ * único pino entre todas as portas. Retorna false se a linha já estiver
+ * em uso
+ *
+ * edge					Borda que gera a interrupção (GPIO_MODE_IT_RISING,
+ * 						GPIO_MODE_IT_FALLING ou GPIO_MODE_IT_RISING_FALLING)
+ * handler				Função chamada dentro da interrupção
+ * priority				Prioridade da interrupção no NVIC
+ *
+ */
+bool DigitalIn::enableInterrupt(uint32_t edge, void (*handler)(), uint32_t priority) {
+	if (error || (handler == NULL)) {
+		return false;
+	}
+
+	uint8_t line = this->line();
+	if ((extiHandlers[line] != 0) && (extiHandlers[line] != this)) {
+		return false;
+	}
+
+	IRQn_Type irq;
+	if (line <= 4) {
+		irq = (IRQn_Type) (EXTI0_IRQn + line);
+	} else if (line <= 9) {
+		irq = EXTI9_5_IRQn;
+	} else {
+		irq = EXTI15_10_IRQn;
+	}
+
+	//O roteamento das portas para a EXTI fica no SYSCFG
+	__HAL_RCC_SYSCFG_CLK_ENABLE();
+
+	this->handler = handler;
+	extiHandlers[line] = this;
+
+	config.Mode = edge;
+	HAL_GPIO_Init(this->port, &config);
+	__HAL_GPIO_EXTI_CLEAR_IT(this->pin);
+
+	HAL_NVIC_SetPriority(irq, priority, 0);
+	HAL_NVIC_EnableIRQ(irq);
+
+	return true;
+}
+
+/**
+ * Desabilita a interrupção do pino
+ */
+void DigitalIn::disableInterrupt() {
+	uint8_t line = this->line();
+	if (extiHandlers[line] != this) {
+		return;
+	}
+
+	//O NVIC pode ser compartilhado com outras linhas, só a linha é mascarada
+	EXTI->IMR &= ~this->pin;
+	__HAL_GPIO_EXTI_CLEAR_IT(this->pin);
+
+	extiHandlers[line] = 0;
+	handler = NULL;
+
+	config.Mode = GPIO_MODE_INPUT;
+	HAL_GPIO_Init(this->port, &config);
+}
+
+/**
+ * Callback da interrupção da EXTI
+ */
+void DigitalIn::interruptCallback() {
+	if (handler != NULL) {
+		handler();
+	}
+}
+
+/**
+ *	Retorna true se houver algum erro
+ *
+ */
+bool DigitalIn::getError() {
+	return error;
+}
+
+/**
+ * Retorna o número da linha da EXTI do pino
+ */
+uint8_t DigitalIn::line() {
+	uint8_t line = 0;
+	while ((line < EXTI_LINES - 1) && !(this->pin & (1UL << line))) {
+		line++;
+	}
+
+	return line;
+}
+
+/**
+ * Trata as linhas pendentes de uma interrupção da EXTI
+ *
+ * first				Primeira linha atendida pela interrupção
+ * last					Última linha atendida pela interrupção
+ */
+static void extiDispatch(uint8_t first, uint8_t last) {
+	for (uint8_t line = first; line <= last; line++) {
+		if (EXTI->PR & (1UL << line)) {
+			EXTI->PR = 1UL << line;
+
+			if (extiHandlers[line] != 0) {
+				extiHandlers[line]->interruptCallback();
+			}
+		}
+	}
+}
+
+//Interruption callbacks
+extern "C" {
+	void EXTI0_IRQHandler() {
+		extiDispatch(0, 0);
+	}
+}
+
+extern "C" {
+	void EXTI1_IRQHandler() {
+		extiDispatch(1, 1);
+	}
+}
+
+extern "C" {
+	void EXTI2_IRQHandler() {
+		extiDispatch(2, 2);
+	}
+}
+
+extern "C" {
+	void EXTI3_IRQHandler() {
+		extiDispatch(3, 3);
+	}
+}
+
+extern "C" {
+	void EXTI4_IRQHandler() {
+		extiDispatch(4, 4);
+	}
+}
+
+extern "C" {
+	void EXTI9_5_IRQHandler() {
+		extiDispatch(5, 9);
+	}
+}
+
+extern "C" {
+	void EXTI15_10_IRQHandler() {
+		extiDispatch(10, 15);
+	}
+}
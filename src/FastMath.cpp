@@ -0,0 +1,195 @@
+/*
+ * FastMath.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <FastMath.h>
+
+//Coeficientes do arco tangente em [0, 1], Abramowitz e Stegun 4.4.49
+#define ATAN_A2 -0.3333314528f
+#define ATAN_A4 0.1999355085f
+#define ATAN_A6 -0.1420889944f
+#define ATAN_A8 0.1065626393f
+#define ATAN_A10 -0.0752896400f
+#define ATAN_A12 0.0429096138f
+#define ATAN_A14 -0.0161657367f
+#define ATAN_A16 0.0028662257f
+
+//Passo da tabela em radianos (2*pi/SIN_TABLE_SIZE), dividido em uma parte
+//com os 12 bits menos significativos zerados e o restante
+#define SIN_STEP_HIGH 0.01226806640625f
+#define SIN_STEP_LOW 3.7798968e-06f
+
+/**
+ * Tabela de senos de uma volta inteira
+ */
+struct SinTable {
+	float entries[SIN_TABLE_SIZE];
+};
+
+/**
+ * Seno em dupla precisão pela série de Taylor, só para gerar a tabela em
+ * tempo de compilação
+ *
+ * angle				Ângulo em radianos entre -pi e pi
+ */
+constexpr double taylorSin(double angle) {
+	double term = angle;
+	double sum = angle;
+
+	for (uint32_t n = 1; n < 20; n++) {
+		term *= -angle * angle / ((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+
+	return sum;
+}
+
+/**
+ * Gera a tabela de senos. Declarada constexpr, a tabela fica na flash
+ */
+constexpr SinTable makeSinTable() {
+	SinTable table = {};
+
+	for (uint32_t i = 0; i < SIN_TABLE_SIZE; i++) {
+		//Ângulos da segunda meia volta como negativos, onde a série converge melhor
+		double angle = 2.0 * 3.14159265358979323846 * i / SIN_TABLE_SIZE;
+		if (i >= SIN_TABLE_SIZE / 2) {
+			angle -= 2.0 * 3.14159265358979323846;
+		}
+		table.entries[i] = (float) taylorSin(angle);
+	}
+
+	return table;
+}
+
+static constexpr SinTable sinTable = makeSinTable();
+
+/**
+ * Seno e cosseno juntos, pela entrada mais próxima da tabela e uma série de
+ * Taylor de terceira ordem a partir dela. Erro absoluto menor que 2e-7 para
+ * |angle| < 50 rad, limitado pela precisão do float. Cerca de 35 ciclos
+ * (estimativa)
+ *
+ * angle				Ângulo em radianos
+ * sin					Onde o seno será escrito
+ * cos					Onde o cosseno será escrito
+ */
+void fastSinCos(float angle, float* sin, float* cos) {
+	//Entrada mais próxima, arredondada sem a libm. A máscara leva qualquer
+	//volta para a tabela
+	float position = angle * (SIN_TABLE_SIZE / (2.0f * FAST_PI));
+	int32_t index = (int32_t) ((position >= 0.0f) ? (position + 0.5f) : (position - 0.5f));
+
+	//Distância até a entrada com o passo dividido em duas partes, a primeira
+	//com poucos bits para que o produto pelo índice seja exato
+	float delta = (angle - (float) index * SIN_STEP_HIGH) - (float) index * SIN_STEP_LOW;
+
+	//O cosseno é o seno um quarto de volta à frente
+	float s = sinTable.entries[index & (SIN_TABLE_SIZE - 1)];
+	float c = sinTable.entries[(index + SIN_TABLE_SIZE / 4) & (SIN_TABLE_SIZE - 1)];
+
+	//sin(a + d) = sin(a)cos(d) + cos(a)sin(d), com cos(d) e sin(d) pela série.
+	//Com |d| <= pi/512 o termo seguinte é menor que 1e-10
+	float delta2 = delta * delta;
+	float cosDelta = 1.0f - 0.5f * delta2;
+	float sinDelta = delta * (1.0f - delta2 * (1.0f / 6.0f));
+
+	*sin = s * cosDelta + c * sinDelta;
+	*cos = c * cosDelta - s * sinDelta;
+}
+
+/**
+ * Seno pela tabela, com a precisão e o custo de fastSinCos
+ *
+ * angle				Ângulo em radianos
+ */
+float fastSin(float angle) {
+	float s, c;
+	fastSinCos(angle, &s, &c);
+	return s;
+}
+
+/**
+ * Cosseno pela tabela, com a precisão e o custo de fastSinCos
+ *
+ * angle				Ângulo em radianos
+ */
+float fastCos(float angle) {
+	float s, c;
+	fastSinCos(angle, &s, &c);
+	return c;
+}
+
+/**
+ * Arco tangente de y/x no quadrante correto, entre -pi e pi. Polinômio de
+ * grau 17 de Abramowitz e Stegun (4.4.49) no octante [0, 1]. Erro absoluto
+ * menor que 4e-7 rad. Cerca de 50 ciclos (estimativa). Retorna 0 para (0, 0)
+ *
+ * y					Coordenada y
+ * x					Coordenada x
+ */
+float fastAtan2(float y, float x) {
+	float absX = (x < 0.0f) ? -x : x;
+	float absY = (y < 0.0f) ? -y : y;
+
+	//Reduz ao octante [0, 1], uma única divisão
+	bool swap = absY > absX;
+	float high = swap ? absY : absX;
+	float low = swap ? absX : absY;
+	if (high == 0.0f) {
+		return 0.0f;
+	}
+
+	float z = low * fastReciprocal(high);
+	float z2 = z * z;
+	float angle = z * (1.0f + z2 * (ATAN_A2 + z2 * (ATAN_A4 + z2 * (ATAN_A6 + z2 * (ATAN_A8
+			+ z2 * (ATAN_A10 + z2 * (ATAN_A12 + z2 * (ATAN_A14 + z2 * ATAN_A16))))))));
+
+	//Volta ao quadrante original
+	if (swap) {
+		angle = 0.5f * FAST_PI - angle;
+	}
+	if (x < 0.0f) {
+		angle = FAST_PI - angle;
+	}
+
+	return (y < 0.0f) ? -angle : angle;
+}
+
+/**
+ * Arco seno, entre -pi/2 e pi/2, por fastAtan2 e fastSqrt. Entradas fora de
+ * [-1, 1] são limitadas. Erro absoluto menor que 3e-7 rad longe de +-1,
+ * onde a precisão do próprio float domina. Cerca de 70 ciclos (estimativa)
+ *
+ * x					Seno do ângulo
+ */
+float fastAsin(float x) {
+	if (x > 1.0f) {
+		x = 1.0f;
+	} else if (x < -1.0f) {
+		x = -1.0f;
+	}
+
+	return fastAtan2(x, fastSqrt((1.0f - x) * (1.0f + x)));
+}
@@ -0,0 +1,100 @@
+/*
+ * PanTilt.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <PanTilt.h>
+
+#include "FastMath.h"
+
+#define RADIANS_TO_DEGREES (180.0f / FAST_PI)
+
+/**
+ * Construtor
+ *
+ * panZero				Ângulo do eixo X apontando para +X em graus
+ * tiltZero				Ângulo do eixo Y com a visada na horizontal em graus
+ */
+PanTilt::PanTilt(float panZero, float tiltZero) {
+	this->panZero = panZero;
+	this->tiltZero = tiltZero;
+
+	setOffsets(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+/**
+ * Define os offsets da montagem, na mesma unidade dos pontos
+ *
+ * height				Altura do eixo tilt sobre a origem
+ * forward				Distância do eixo pan ao eixo tilt, para a frente
+ * lateral				Distância da linha de visada ao eixo pan, para a esquerda
+ * sight				Distância da linha de visada ao eixo tilt, para cima
+ */
+void PanTilt::setOffsets(float height, float forward, float lateral, float sight) {
+	this->height = height;
+	this->forward = forward;
+	this->lateral = lateral;
+	this->sight = sight;
+}
+
+/**
+ * Calcula os ângulos dos eixos para apontar para um ponto. Retorna false
+ * se o ponto estiver perto demais para a linha de visada alcançá-lo
+ *
+ * x					Coordenada X do ponto
+ * y					Coordenada Y do ponto
+ * z					Coordenada Z do ponto
+ * angles				Array onde o ângulo de cada eixo em graus será escrito
+ */
+bool PanTilt::pointAt(float x, float y, float z, float angles[N_AXIS]) {
+	//Pan: a visada deslocada para a esquerda passa pelo ponto quando a cabeça
+	//gira para a direita o ângulo do offset visto do ponto
+	float radius2 = x * x + y * y;
+	float lateral2 = lateral * lateral;
+	if (radius2 <= lateral2) {
+		return false;
+	}
+	float pan = fastAtan2(y, x) - fastAsin(lateral / fastSqrt(radius2));
+
+	//Tilt: no plano vertical da visada, a partir do eixo tilt
+	float horizontal = fastSqrt(radius2 - lateral2) - forward;
+	float vertical = z - height;
+	float distance2 = horizontal * horizontal + vertical * vertical;
+	if (distance2 <= sight * sight) {
+		return false;
+	}
+	float tilt = fastAtan2(vertical, horizontal) - fastAsin(sight / fastSqrt(distance2));
+
+	angles[X_AXIS] = panZero + pan * RADIANS_TO_DEGREES;
+	angles[Y_AXIS] = tiltZero + tilt * RADIANS_TO_DEGREES;
+
+	//Pan entre 0 e 360 graus, como os comandos em ângulo
+	while (angles[X_AXIS] < 0.0f) {
+		angles[X_AXIS] += 360.0f;
+	}
+	while (angles[X_AXIS] >= 360.0f) {
+		angles[X_AXIS] -= 360.0f;
+	}
+
+	return true;
+}
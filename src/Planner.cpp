@@ -0,0 +1,733 @@
+/*
+ * Planner.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <Planner.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "FastMath.h"
+#include "Stepper.h"
+
+/**
+ * Construtor
+ *
+ * stepsPerDegree		Passos por grau de cada eixo
+ * maxFeedrate			Velocidade máxima de cada eixo em graus/min
+ * acceleration			Aceleração de cada eixo em graus/s²
+ * junctionDeviation	Desvio de junção em graus, define a velocidade nas curvas
+ * sCurve				True para perfil em curva S (jerk limitado), false para trapezoidal
+ */
+Planner::Planner(const float stepsPerDegree[N_AXIS], const float maxFeedrate[N_AXIS],
+		const float acceleration[N_AXIS], float junctionDeviation, bool sCurve) {
+	head = 0;
+	tail = 0;
+
+	this->junctionDeviation = junctionDeviation;
+	this->sCurve = sCurve;
+	feedOverride = 1.0f;
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		this->stepsPerDegree[i] = stepsPerDegree[i];
+		this->maxSpeed[i] = 0.0f;
+		this->acceleration[i] = 0.0f;
+		setMaxFeedrate(i, maxFeedrate[i]);
+		setAcceleration(i, acceleration[i]);
+
+		position[i] = 0;
+		previousUnitVector[i] = 0.0f;
+		previousPvtRate[i] = 0.0f;
+	}
+	previousProgrammedSpeed = 0.0f;
+	previousMaxSpeed = 0.0f;
+}
+
+/**
+ * Adiciona um movimento em linha à fila. Retorna false se a fila estiver
+ * cheia
+ *
+ * target				Posição absoluta final de cada eixo em passos
+ * feedrate				Velocidade ao longo do caminho em graus/min
+ */
+bool Planner::bufferLine(const int32_t target[N_AXIS], float feedrate) {
+	if (full()) {
+		return false;
+	}
+
+	PlanBlock* block = &blocks[head];
+	int32_t steps[N_AXIS];
+	float delta[N_AXIS];
+
+	block->stepEventCount = 0;
+	block->distance = 0.0f;
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		steps[i] = target[i] - position[i];
+		block->steps[i] = abs(steps[i]);
+		block->direction[i] = (steps[i] > 0) ? CW : CCW;
+
+		if (block->steps[i] > block->stepEventCount) {
+			block->stepEventCount = block->steps[i];
+		}
+
+		delta[i] = steps[i] / stepsPerDegree[i];
+		block->distance += delta[i] * delta[i];
+	}
+
+	//Movimento sem passos não entra na fila
+	if (block->stepEventCount == 0) {
+		return true;
+	}
+
+	block->distance = fastSqrt(block->distance);
+
+	float inverseDistance = 1.0f / block->distance;
+	float unitVector[N_AXIS];
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		unitVector[i] = delta[i] * inverseDistance;
+	}
+
+	//Velocidade e aceleração ao longo do caminho limitadas pelo eixo mais
+	//restritivo nessa direção. Os eixos andam sincronizados pelo Bresenham,
+	//então nenhum passa do seu limite
+	block->acceleration = limitByAxis(acceleration, unitVector);
+	block->maxSpeed = limitByAxis(maxSpeed, unitVector);
+
+	//Velocidade ao longo do caminho e taxa de passos equivalente do eixo principal
+	block->programmedSpeed = feedrate / 60.0f;
+	block->nominalSpeed = fminf(block->programmedSpeed * feedOverride, block->maxSpeed);
+	block->nominalRate = ceilf(block->stepEventCount * block->nominalSpeed * inverseDistance);
+	block->accelerationSteps = ceilf(block->stepEventCount * block->acceleration * inverseDistance);
+	block->busy = false;
+	block->sCurve = sCurve;
+	block->pvt = false;
+
+	//Velocidade máxima na junção com o bloco anterior, limitada pelo desvio de
+	//junção: a velocidade com que um arco tangente aos dois segmentos, a no
+	//máximo junctionDeviation graus do vértice, seria percorrido com a
+	//aceleração configurada. O limite pelas velocidades nominais é aplicado
+	//à parte, pois elas mudam com o override
+	float maxJunctionSpeed = MINIMUM_PLANNER_SPEED;
+	if (!empty() && (previousProgrammedSpeed > 0.0f)) {
+		float cosTheta = 0.0f;
+		for (uint8_t i = 0; i < N_AXIS; i++) {
+			cosTheta -= previousUnitVector[i] * unitVector[i];
+		}
+
+		//Reversão total de direção mantém a velocidade mínima
+		if (cosTheta < 0.999999f) {
+			//Segmentos colineares não são limitados
+			maxJunctionSpeed = INFINITY;
+
+			if (cosTheta > -0.999999f) {
+				//Aceleração centrípeta na direção da mudança de velocidade
+				float junctionVector[N_AXIS];
+				float norm = 0.0f;
+				for (uint8_t i = 0; i < N_AXIS; i++) {
+					junctionVector[i] = unitVector[i] - previousUnitVector[i];
+					norm += junctionVector[i] * junctionVector[i];
+				}
+				norm = 1.0f / fastSqrt(norm);
+				for (uint8_t i = 0; i < N_AXIS; i++) {
+					junctionVector[i] *= norm;
+				}
+				float junctionAcceleration = limitByAxis(acceleration, junctionVector);
+
+				float sinThetaD2 = fastSqrt(0.5f * (1.0f - cosTheta));
+				maxJunctionSpeed = fastSqrt(junctionAcceleration * junctionDeviation * sinThetaD2 / (1.0f - sinThetaD2));
+			}
+		}
+	}
+	block->maxJunctionSpeed = maxJunctionSpeed;
+	block->maxEntrySpeed = fminf(maxJunctionSpeed,
+			fminf(fminf(previousProgrammedSpeed * feedOverride, previousMaxSpeed), block->nominalSpeed));
+
+	//Velocidade de entrada inicial considera que o bloco termina parado
+	float allowableSpeed = maxAllowableSpeed(-block->acceleration, MINIMUM_PLANNER_SPEED, block->distance);
+	block->entrySpeed = fminf(block->maxEntrySpeed, allowableSpeed);
+	block->nominalLengthFlag = (block->nominalSpeed <= allowableSpeed);
+	block->recalculateFlag = true;
+
+	//Perfil inicial terminando parado
+	calculateTrapezoid(block, block->entrySpeed, MINIMUM_PLANNER_SPEED);
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		previousUnitVector[i] = unitVector[i];
+	}
+	previousProgrammedSpeed = block->programmedSpeed;
+	previousMaxSpeed = block->maxSpeed;
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		position[i] = target[i];
+	}
+
+	head = nextIndex(head);
+
+	recalculate();
+
+	//Sequência PVT seguinte parte do repouso
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		previousPvtRate[i] = 0.0f;
+	}
+
+	return true;
+}
+
+/**
+ * Adiciona um ponto PVT à fila. Os eixos seguem uma cúbica partindo da
+ * posição e velocidade do ponto anterior, ou do repouso, até a posição
+ * e velocidade pedidas. Retorna false se a fila estiver cheia
+ *
+ * target				Posição absoluta final de cada eixo em passos
+ * velocity				Velocidade final de cada eixo em graus/s, com sinal
+ * duration				Tempo para chegar ao ponto em s
+ */
+bool Planner::bufferPvt(const int32_t target[N_AXIS], const float velocity[N_AXIS], float duration) {
+	if (full()) {
+		return false;
+	}
+
+	PlanBlock* block = &blocks[head];
+
+	block->stepEventCount = 0;
+	block->distance = 0.0f;
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		int32_t steps = target[i] - position[i];
+		block->steps[i] = abs(steps);
+		block->direction[i] = (steps > 0) ? CW : CCW;
+
+		if (block->steps[i] > block->stepEventCount) {
+			block->stepEventCount = block->steps[i];
+		}
+
+		float delta = steps / stepsPerDegree[i];
+		block->distance += delta * delta;
+
+		block->pvtEntryRate[i] = previousPvtRate[i];
+		block->pvtExitRate[i] = velocity[i] * stepsPerDegree[i];
+	}
+	block->distance = fastSqrt(block->distance);
+
+	//Mesmo sem passos o ponto fica na fila, os eixos esperam o tempo pedido
+	block->pvt = true;
+	block->pvtDuration = duration;
+	block->busy = false;
+
+	//A trajetória é definida pelo host, para o planejador o ponto começa e
+	//termina parado, então blocos em linha vizinhos partem e param nele
+	block->programmedSpeed = 0.0f;
+	block->nominalSpeed = 0.0f;
+	block->maxJunctionSpeed = MINIMUM_PLANNER_SPEED;
+	block->maxEntrySpeed = MINIMUM_PLANNER_SPEED;
+	block->entrySpeed = MINIMUM_PLANNER_SPEED;
+	block->exitSpeed = MINIMUM_PLANNER_SPEED;
+	block->nominalLengthFlag = true;
+	block->recalculateFlag = false;
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		previousPvtRate[i] = block->pvtExitRate[i];
+		position[i] = target[i];
+	}
+	previousProgrammedSpeed = 0.0f;
+	previousMaxSpeed = 0.0f;
+
+	head = nextIndex(head);
+
+	recalculate();
+
+	return true;
+}
+
+/**
+ * Define a posição atual sem movimentar os eixos. Só deve ser chamado com
+ * a fila vazia
+ *
+ * position				Posição de cada eixo em passos
+ */
+void Planner::setPosition(const int32_t position[N_AXIS]) {
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		this->position[i] = position[i];
+	}
+
+	//Próximo bloco parte do repouso
+	previousProgrammedSpeed = 0.0f;
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		previousPvtRate[i] = 0.0f;
+	}
+}
+
+/**
+ * Retorna a posição ao fim do último bloco adicionado em passos
+ *
+ * position				Array onde a posição de cada eixo será escrita
+ */
+void Planner::getPosition(int32_t position[N_AXIS]) {
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		position[i] = this->position[i];
+	}
+}
+
+/**
+ * Descarta todos os blocos da fila. Só deve ser chamado com o gerador de
+ * passos parado
+ */
+void Planner::clear() {
+	tail = head;
+
+	//Próximo bloco parte do repouso
+	previousProgrammedSpeed = 0.0f;
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		previousPvtRate[i] = 0.0f;
+	}
+}
+
+/**
+ * Faz o próximo ponto PVT partir do repouso, no início de uma sequência
+ */
+void Planner::resetPvt() {
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		previousPvtRate[i] = 0.0f;
+	}
+}
+
+/**
+ * Define a aceleração de todos os eixos utilizada nos próximos blocos
+ *
+ * acceleration			Aceleração em graus/s²
+ */
+void Planner::setAcceleration(float acceleration) {
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		setAcceleration(i, acceleration);
+	}
+}
+
+/**
+ * Define a aceleração de um eixo utilizada nos próximos blocos
+ *
+ * axis					Índice do eixo
+ * acceleration			Aceleração em graus/s²
+ */
+void Planner::setAcceleration(uint8_t axis, float acceleration) {
+	if ((axis < N_AXIS) && (acceleration > 0.0f)) {
+		if (sCurve) {
+			acceleration *= S_CURVE_ACCELERATION_FACTOR;
+		}
+		this->acceleration[axis] = acceleration;
+	}
+}
+
+/**
+ * Define a velocidade máxima de um eixo utilizada nos próximos blocos
+ *
+ * axis					Índice do eixo
+ * feedrate				Velocidade máxima em graus/min
+ */
+void Planner::setMaxFeedrate(uint8_t axis, float feedrate) {
+	if ((axis < N_AXIS) && (feedrate > 0.0f)) {
+		maxSpeed[axis] = feedrate / 60.0f;
+	}
+}
+
+/**
+ * Retorna os passos por grau de um eixo
+ *
+ * axis					Índice do eixo
+ */
+float Planner::getStepsPerDegree(uint8_t axis) {
+	return stepsPerDegree[axis];
+}
+
+/**
+ * Retorna a velocidade máxima de um eixo em graus/s
+ *
+ * axis					Índice do eixo
+ */
+float Planner::getMaxSpeed(uint8_t axis) {
+	return maxSpeed[axis];
+}
+
+/**
+ * Retorna a aceleração de um eixo em graus/s²
+ *
+ * axis					Índice do eixo
+ */
+float Planner::getAcceleration(uint8_t axis) {
+	return acceleration[axis];
+}
+
+/**
+ * Aplica um override às velocidades programadas de todos os blocos e
+ * recalcula a fila. O bloco em execução só tem a velocidade de saída
+ * limitada, o restante dele é replanejado pelo gerador de passos
+ *
+ * percent				Porcentagem da velocidade programada
+ */
+void Planner::setFeedOverride(uint16_t percent) {
+	feedOverride = percent / 100.0f;
+
+	uint8_t newest = previousIndex(head);
+	float previousNominalSpeed = 0.0f;
+
+	for (uint8_t index = tail; index != head; index = nextIndex(index)) {
+		PlanBlock* block = &blocks[index];
+
+		//Pontos PVT seguem o tempo pedido pelo host, sem override
+		if (block->pvt) {
+			previousNominalSpeed = 0.0f;
+			continue;
+		}
+
+		block->nominalSpeed = fminf(block->programmedSpeed * feedOverride, block->maxSpeed);
+		block->nominalRate = ceilf(block->stepEventCount * block->nominalSpeed / block->distance);
+		block->recalculateFlag = true;
+
+		if (block->busy) {
+			block->exitSpeed = fminf(block->exitSpeed, block->nominalSpeed);
+		} else if (index != tail) {
+			//A entrada do bloco mais antigo continua o movimento atual, as
+			//outras são refeitas pelas passagens do recálculo
+			float allowableSpeed = maxAllowableSpeed(-block->acceleration, MINIMUM_PLANNER_SPEED, block->distance);
+			block->maxEntrySpeed = fminf(block->maxJunctionSpeed,
+					fminf(previousNominalSpeed, block->nominalSpeed));
+			block->nominalLengthFlag = (block->nominalSpeed <= allowableSpeed);
+			block->entrySpeed = (index == newest) ? fminf(block->maxEntrySpeed, allowableSpeed)
+					: MINIMUM_PLANNER_SPEED;
+		}
+
+		previousNominalSpeed = block->nominalSpeed;
+	}
+
+	if (!empty()) {
+		recalculate();
+	}
+}
+
+/**
+ * Define a velocidade de saída do bloco em execução depois que o gerador de
+ * passos replanejou o restante dele, e recalcula a fila a partir dela
+ *
+ * exitSpeed			Velocidade de saída em graus/s
+ */
+void Planner::setCurrentExitSpeed(float exitSpeed) {
+	if (!empty() && blocks[tail].busy) {
+		blocks[tail].exitSpeed = exitSpeed;
+		recalculate();
+	}
+}
+
+/**
+ * Retorna o bloco mais antigo da fila ou NULL se a fila estiver vazia
+ */
+PlanBlock* Planner::currentBlock() {
+	if (empty()) {
+		return NULL;
+	}
+
+	return &blocks[tail];
+}
+
+/**
+ * Remove o bloco mais antigo da fila
+ */
+void Planner::discardCurrentBlock() {
+	if (!empty()) {
+		tail = nextIndex(tail);
+	}
+}
+
+/**
+ * Retorna true se a fila estiver cheia
+ */
+bool Planner::full() {
+	return nextIndex(head) == tail;
+}
+
+/**
+ * Retorna true se a fila estiver vazia
+ */
+bool Planner::empty() {
+	return head == tail;
+}
+
+/**
+ * Retorna o índice seguinte ao informado na fila
+ */
+uint8_t Planner::nextIndex(uint8_t index) {
+	return (index + 1) & (BLOCK_BUFFER_SIZE - 1);
+}
+
+/**
+ * Retorna o índice anterior ao informado na fila
+ */
+uint8_t Planner::previousIndex(uint8_t index) {
+	return (index - 1) & (BLOCK_BUFFER_SIZE - 1);
+}
+
+/**
+ * Retorna o maior valor ao longo de uma direção que respeita o limite de
+ * cada eixo, ou seja, o limite do eixo mais restritivo nessa direção
+ *
+ * limits				Limite de cada eixo
+ * unitVector			Direção do movimento, normalizada
+ */
+float Planner::limitByAxis(const float limits[N_AXIS], const float unitVector[N_AXIS]) {
+	float limit = INFINITY;
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		if (unitVector[i] != 0.0f) {
+			limit = fminf(limit, fabsf(limits[i] / unitVector[i]));
+		}
+	}
+
+	return limit;
+}
+
+/**
+ * Calcula a maior velocidade com que se pode começar um trecho e ainda
+ * conseguir chegar a velocidade final dentro da distância informada
+ *
+ * accel				Aceleração em graus/s² (negativa para desaceleração)
+ * targetSpeed			Velocidade final em graus/s
+ * distance				Distância disponível em graus
+ */
+float Planner::maxAllowableSpeed(float accel, float targetSpeed, float distance) {
+	return fastSqrt(targetSpeed * targetSpeed - 2.0f * accel * distance);
+}
+
+/**
+ * Calcula a distância em passos para ir de uma taxa de passos a outra
+ *
+ * initialRate			Taxa inicial em passos/s
+ * targetRate			Taxa final em passos/s
+ * accel				Aceleração em passos/s² (negativa para desaceleração)
+ */
+float Planner::accelerationDistance(float initialRate, float targetRate, float accel) {
+	return (targetRate * targetRate - initialRate * initialRate) / (2.0f * accel);
+}
+
+/**
+ * Calcula em que passo deve começar a desaceleração para um bloco que não
+ * alcança a velocidade nominal
+ *
+ * initialRate			Taxa inicial em passos/s
+ * finalRate			Taxa final em passos/s
+ * accel				Aceleração em passos/s²
+ * distance				Quantidade de passos do bloco
+ */
+float Planner::intersectionDistance(float initialRate, float finalRate, float accel, float distance) {
+	return (2.0f * accel * distance - initialRate * initialRate + finalRate * finalRate) / (4.0f * accel);
+}
+
+/**
+ * Calcula o perfil trapezoidal de velocidade de um bloco. Retorna false se
+ * o bloco já estiver em execução e não puder mais ser alterado
+ *
+ * block				Bloco a ser calculado
+ * entrySpeed			Velocidade de entrada em graus/s
+ * exitSpeed			Velocidade de saída em graus/s
+ */
+bool Planner::calculateTrapezoid(PlanBlock* block, float entrySpeed, float exitSpeed) {
+	//Pontos PVT não têm perfil, sempre começam e terminam parados
+	if (block->pvt) {
+		return !block->busy;
+	}
+
+	uint32_t initialRate = ceilf(block->nominalRate * entrySpeed / block->nominalSpeed);
+	uint32_t finalRate = ceilf(block->nominalRate * exitSpeed / block->nominalSpeed);
+
+	if (initialRate < MINIMUM_STEP_RATE) {
+		initialRate = MINIMUM_STEP_RATE;
+	}
+	if (finalRate < MINIMUM_STEP_RATE) {
+		finalRate = MINIMUM_STEP_RATE;
+	}
+
+	//Passos de aceleração, cruzeiro e desaceleração. Com o override reduzido
+	//a entrada pode estar acima da velocidade nominal, e a primeira fase
+	//desacelera até ela
+	float accel = block->accelerationSteps;
+	bool slowDown = initialRate > block->nominalRate;
+	int32_t accelerateSteps = ceilf(accelerationDistance(initialRate, block->nominalRate, slowDown ? -accel : accel));
+	int32_t decelerateSteps = floorf(accelerationDistance(block->nominalRate, finalRate, -accel));
+	int32_t plateauSteps = block->stepEventCount - accelerateSteps - decelerateSteps;
+
+	//Bloco curto demais para alcançar a velocidade nominal, perfil triangular
+	//ou, se a entrada estiver acima da nominal, desaceleração no bloco inteiro
+	if (plateauSteps < 0) {
+		if (slowDown) {
+			accelerateSteps = 0;
+		} else {
+			accelerateSteps = ceilf(intersectionDistance(initialRate, finalRate, accel, block->stepEventCount));
+		}
+		if (accelerateSteps < 0) {
+			accelerateSteps = 0;
+		} else if (accelerateSteps > (int32_t) block->stepEventCount) {
+			accelerateSteps = block->stepEventCount;
+		}
+		plateauSteps = 0;
+	}
+
+	//Na curva S a velocidade segue 3t²-2t³ ao longo de cada rampa. A velocidade
+	//média da rampa é a mesma da trapezoidal, então os passos de cada fase não
+	//mudam, só a forma como a velocidade varia dentro delas
+	uint32_t peakRate = block->nominalRate;
+	if (plateauSteps == 0) {
+		peakRate = fastSqrt((float) initialRate * initialRate + 2.0f * accel * accelerateSteps);
+		if ((peakRate > block->nominalRate) && !slowDown) {
+			peakRate = block->nominalRate;
+		}
+		if (peakRate < initialRate) {
+			peakRate = initialRate;
+		}
+	}
+	if (peakRate < finalRate) {
+		peakRate = finalRate;
+	}
+
+	//Bloco já dividido em segmentos mantém o perfil com que começou
+	if (block->busy) {
+		return false;
+	}
+
+	block->initialRate = initialRate;
+	block->finalRate = finalRate;
+	block->accelerateUntil = accelerateSteps;
+	block->decelerateAfter = accelerateSteps + plateauSteps;
+	block->peakRate = peakRate;
+	block->exitSpeed = exitSpeed;
+
+	return true;
+}
+
+/**
+ * Recalcula as velocidades de entrada e os perfis de todos os blocos da fila
+ */
+void Planner::recalculate() {
+	//A fila é percorrida a partir do bloco mais antigo
+	uint8_t first = tail;
+
+	reversePass(first);
+
+	//O bloco em execução termina na velocidade com que foi planejado, então o
+	//seguinte tem que começar nela
+	uint8_t second = nextIndex(first);
+	if (blocks[first].busy && (second != head)) {
+		blocks[second].entrySpeed = blocks[first].exitSpeed;
+		blocks[second].recalculateFlag = true;
+	}
+
+	forwardPass(first);
+	recalculateTrapezoids(first);
+}
+
+/**
+ * Percorre a fila do bloco mais novo para o mais antigo, garantindo que
+ * cada bloco consiga desacelerar até a velocidade de entrada do seguinte
+ */
+void Planner::reversePass(uint8_t first) {
+	uint8_t index = previousIndex(head);
+	PlanBlock* next = NULL;
+
+	//A velocidade de entrada do bloco em execução não pode mais ser alterada
+	while (index != first) {
+		PlanBlock* current = &blocks[index];
+
+		if ((next != NULL) && (current->entrySpeed != current->maxEntrySpeed)) {
+			//Se o bloco não alcança a velocidade máxima de entrada partindo da
+			//velocidade de entrada do seguinte, limita pela desaceleração
+			if (!current->nominalLengthFlag && (current->maxEntrySpeed > next->entrySpeed)) {
+				current->entrySpeed = fminf(current->maxEntrySpeed,
+						maxAllowableSpeed(-current->acceleration, next->entrySpeed, current->distance));
+			} else {
+				current->entrySpeed = current->maxEntrySpeed;
+			}
+			current->recalculateFlag = true;
+		}
+
+		next = current;
+		index = previousIndex(index);
+	}
+}
+
+/**
+ * Percorre a fila do bloco mais antigo para o mais novo, garantindo que
+ * cada bloco consiga acelerar até a velocidade de entrada do seguinte
+ */
+void Planner::forwardPass(uint8_t first) {
+	uint8_t index = first;
+	PlanBlock* previous = NULL;
+
+	while (index != head) {
+		PlanBlock* current = &blocks[index];
+
+		if ((previous != NULL) && !previous->nominalLengthFlag
+				&& (previous->entrySpeed < current->entrySpeed)) {
+			float entrySpeed = fminf(current->entrySpeed,
+					maxAllowableSpeed(-previous->acceleration, previous->entrySpeed, previous->distance));
+
+			if (current->entrySpeed != entrySpeed) {
+				current->entrySpeed = entrySpeed;
+				current->recalculateFlag = true;
+			}
+		}
+
+		previous = current;
+		index = nextIndex(index);
+	}
+}
+
+/**
+ * Recalcula os perfis dos blocos cujas velocidades de entrada ou saída
+ * foram alteradas
+ */
+void Planner::recalculateTrapezoids(uint8_t first) {
+	uint8_t index = first;
+	PlanBlock* current = NULL;
+	PlanBlock* next = NULL;
+
+	while (index != head) {
+		current = next;
+		next = &blocks[index];
+
+		if ((current != NULL) && (current->recalculateFlag || next->recalculateFlag)) {
+			//Se o bloco já está em execução, o seguinte começa na velocidade de
+			//saída com que ele foi planejado
+			if (!calculateTrapezoid(current, current->entrySpeed, next->entrySpeed)) {
+				next->entrySpeed = current->exitSpeed;
+				next->recalculateFlag = true;
+			}
+			current->recalculateFlag = false;
+		}
+
+		index = nextIndex(index);
+	}
+
+	//O último bloco sempre termina na velocidade mínima
+	if (next != NULL) {
+		calculateTrapezoid(next, next->entrySpeed, MINIMUM_PLANNER_SPEED);
+		next->recalculateFlag = false;
+	}
+}
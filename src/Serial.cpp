@@ -29,12 +29,39 @@
 
 #define USART_NUMBER 3
 
+#define DMA_RX_STREAMS 2
+
 Serial* handlers[USART_NUMBER] = {0};
 
+//Seriais com recepção por DMA: DMA1 Stream5 (USART2) e DMA2 Stream2 (USART1 ou USART6)
+Serial* dmaHandlers[DMA_RX_STREAMS] = {0};
+
+//Seriais com transmissão por DMA, na mesma ordem de handlers: DMA2 Stream7
+//(USART1), DMA1 Stream6 (USART2) e DMA2 Stream6 (USART6)
+Serial* dmaTxHandlers[USART_NUMBER] = {0};
+
+//Callbacks do DMA, chamados a cada metade do buffer escrita
+static void dmaRxCallback(DMA_HandleTypeDef* hdma) {
+	((Serial*) hdma->Parent)->rxDmaCallback();
+}
+
+//Callback do DMA de transmissão, chamado ao fim ou em erro de uma transferência
+static void dmaTxCallback(DMA_HandleTypeDef* hdma) {
+	((Serial*) hdma->Parent)->txDmaCallback();
+}
+
 Serial::Serial(USART_TypeDef *instance, uint32_t baud) {
 	error = true;
 
-	rxBuffer = new (std::nothrow) CircularBuffer<uint8_t>(64);
+	realtimeHandler = NULL;
+	dmaBuffer = NULL;
+	txBuffer = NULL;
+
+	flowControl = SERIAL_FLOW_NONE;
+	rxThrottled = false;
+	txPaused = false;
+	txFlowByte = 0;
+	txFlowSending = false;
 
 	huart.Instance = instance;
 	huart.Init.BaudRate = baud;
@@ -139,118 +166,44 @@ Serial::Serial(USART_TypeDef *instance, uint32_t baud) {
 	error = false;
 }
 
-Serial::Serial(USART_TypeDef *instance, uint32_t baud, uint16_t bufferSize) {
-	error = true;
-
-	if ( (bufferSize <= 0) || (bufferSize >= 512)) {
-		return;
-	}
-	rxBuffer = new (std::nothrow) CircularBuffer<uint8_t>(bufferSize);
-
-	huart.Instance = instance;
-	huart.Init.BaudRate = baud;
-	huart.Init.WordLength = UART_WORDLENGTH_8B;
-	huart.Init.StopBits = UART_STOPBITS_1;
-	huart.Init.Parity = UART_PARITY_NONE;
-	huart.Init.Mode = UART_MODE_TX_RX;
-	huart.Init.HwFlowCtl = UART_HWCONTROL_NONE;
-	huart.Init.OverSampling = UART_OVERSAMPLING_16;
-	//huart.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
-	//huart.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
-
-	if (huart.Instance == USART1) {
-		// UART clock enable
-		__HAL_RCC_USART1_CLK_ENABLE();
-
-		// GPIO clock enable
-		__HAL_RCC_GPIOA_CLK_ENABLE();
-
-		// USART1 GPIO Configuration
-		// PA9     ------> USART1_TX
-		// PA10    ------> USART1_RX
-		GPIO_InitTypeDef GPIO_InitStruct;
-		GPIO_InitStruct.Pin = GPIO_PIN_9 | GPIO_PIN_10;
-		GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-		GPIO_InitStruct.Pull = GPIO_PULLUP;
-		GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-		GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
-		HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-		// Set callback handler
-		handlers[0] = this;
-
-		// USART2 interrupt Init
-		HAL_NVIC_SetPriority(USART1_IRQn, 3, 0);
-		HAL_NVIC_EnableIRQ(USART1_IRQn);
-
-		__HAL_UART_ENABLE_IT(&huart, UART_IT_RXNE);
-
-	} else if (huart.Instance == USART2) {
-		// UART clock enable
-		__HAL_RCC_USART2_CLK_ENABLE();
-
-		// GPIO clock enable
-		__HAL_RCC_GPIOA_CLK_ENABLE();
-
-		// USART2 GPIO Configuration
-		// PA2     ------> USART2_TX
-		// PA3     ------> USART2_RX
-		GPIO_InitTypeDef GPIO_InitStruct;
-		GPIO_InitStruct.Pin = GPIO_PIN_2 | GPIO_PIN_3;
-		GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-		GPIO_InitStruct.Pull = GPIO_PULLUP;
-		GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-		GPIO_InitStruct.Alternate = GPIO_AF7_USART2;
-		HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-		// Set callback handler
-		handlers[1] = this;
-
-		// USART2 interrupt Init
-		HAL_NVIC_SetPriority(USART2_IRQn, 3, 0);
-		HAL_NVIC_EnableIRQ(USART2_IRQn);
-
-		__HAL_UART_ENABLE_IT(&huart, UART_IT_RXNE);
-
-	} else if (huart.Instance == USART6) {
-		// UART clock enable
-		__HAL_RCC_USART6_CLK_ENABLE();
-
-		// GPIO clock enable
-		__HAL_RCC_GPIOC_CLK_ENABLE();
-
-		// USART6 GPIO Configuration
-		// PC6    ------> USART6_TX
-		// PC7    ------> USART6_RX
-		GPIO_InitTypeDef GPIO_InitStruct;
-		GPIO_InitStruct.Pin = GPIO_PIN_6 | GPIO_PIN_7;
-		GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-		GPIO_InitStruct.Pull = GPIO_PULLUP;
-		GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-		GPIO_InitStruct.Alternate = GPIO_AF8_USART6;
-		HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+Serial::~Serial() {
+	if (!error) {
+		if (dmaBuffer != NULL) {
+			CLEAR_BIT(huart.Instance->CR3, USART_CR3_DMAR);
+			HAL_DMA_Abort(&hdmaRx);
+			HAL_DMA_DeInit(&hdmaRx);
+
+			for (uint8_t i = 0; i < DMA_RX_STREAMS; i++) {
+				if (dmaHandlers[i] == this) {
+					dmaHandlers[i] = 0;
+				}
+			}
+
+			delete[] dmaBuffer;
+			dmaBuffer = NULL;
+		}
 
-		// Set callback handler
-		handlers[2] = this;
+		if (flowControl == SERIAL_FLOW_RTS_CTS) {
+			CLEAR_BIT(huart.Instance->CR3, USART_CR3_CTSE);
+			HAL_GPIO_DeInit(flowPort, ctsPin | rtsPin);
+		}
 
-		// USART3 interrupt Init
-		HAL_NVIC_SetPriority(USART6_IRQn, 3, 0);
-		HAL_NVIC_EnableIRQ(USART6_IRQn);
+		if (txBuffer != NULL) {
+			CLEAR_BIT(huart.Instance->CR3, USART_CR3_DMAT);
+			HAL_NVIC_DisableIRQ(txIrq);
+			HAL_DMA_Abort(&hdmaTx);
+			HAL_DMA_DeInit(&hdmaTx);
 
-		__HAL_UART_ENABLE_IT(&huart, UART_IT_RXNE);
-	} else {
-		return;
-	}
+			for (uint8_t i = 0; i < USART_NUMBER; i++) {
+				if (dmaTxHandlers[i] == this) {
+					dmaTxHandlers[i] = 0;
+				}
+			}
 
-	if (HAL_UART_Init(&huart) != HAL_OK) {
-		return;
-	}
-
-	error = false;
-}
+			delete[] txBuffer;
+			txBuffer = NULL;
+		}
 
-Serial::~Serial() {
-	if (!error) {
 		if (huart.Instance == USART1) {
 			// UART clock disable
 			__HAL_RCC_USART1_CLK_DISABLE();
@@ -306,10 +259,44 @@ Serial::~Serial() {
 	}
 }
 
-void Serial::write(char *data, uint16_t length) {
-	if (!error) {
+bool Serial::write(char *data, uint16_t length) {
+	if (error) {
+		return false;
+	}
+
+	if (txBuffer == NULL) {
 		while (HAL_UART_Transmit(&huart, (uint8_t*) data, length, 0xFFFF) == HAL_BUSY);
+		return true;
 	}
+
+	//Tudo ou nada, uma mensagem cortada confundiria quem está do outro lado
+	if (length > txFree()) {
+		txOverflows++;
+		return false;
+	}
+
+	//Só o loop principal escreve na fila e só o DMA a esvazia, então txHead
+	//é atualizado apenas depois da cópia
+	uint16_t head = txHead;
+	uint16_t first = txSize - head;
+	if (first > length) {
+		first = length;
+	}
+	std::memcpy(&txBuffer[head], data, first);
+	std::memcpy(txBuffer, &data[first], length - first);
+
+	head += length;
+	if (head >= txSize) {
+		head -= txSize;
+	}
+	txHead = head;
+
+	//O callback do DMA e a recepção de XON e XOFF também iniciam transferências
+	__disable_irq();
+	startTransmit();
+	__enable_irq();
+
+	return true;
 }
 
 void Serial::print(std::string data) {
@@ -360,26 +347,38 @@ void Serial::println(const char *fmt, ...) {
 }
 
 size_t Serial::available() {
-	return rxBuffer->size();
+	return rxBuffer.size();
 }
 
-void Serial::read(uint8_t* data, uint16_t length) {
-	if (!error) {
-		for (uint16_t i = 0; i < length; i++) {
-			data[i] = rxBuffer->get();
-		}
+uint16_t Serial::read(uint8_t* data, uint16_t length) {
+	if (error) {
+		return 0;
 	}
+
+	uint16_t count = rxBuffer.read(data, length);
+	releaseReception();
+	return count;
+}
+
+SerialRxBuffer::Span Serial::readSpan() {
+	return rxBuffer.readSpan();
+}
+
+void Serial::consume(size_t length) {
+	rxBuffer.consume(length);
+	releaseReception();
 }
 
 void Serial::peek(uint8_t* data) {
 	if (!error) {
-		*data = rxBuffer->peek();
+		*data = rxBuffer.peek();
 	}
 }
 
 void Serial::getChar(uint8_t* data) {
 	if (!error) {
-		*data = rxBuffer->get();
+		*data = rxBuffer.get();
+		releaseReception();
 	}
 }
 
@@ -393,10 +392,427 @@ void Serial::interruptCallback() {
 	flag = __HAL_UART_GET_FLAG(&huart, UART_FLAG_RXNE);
 	source = __HAL_UART_GET_IT_SOURCE(&huart, UART_IT_RXNE);
 	if ( (flag != RESET) && (source != RESET) ) {
-		rxBuffer->put( (uint8_t)(huart.Instance->DR & (uint16_t)0x00FF) );
+		uint8_t data = (uint8_t)(huart.Instance->DR & (uint16_t)0x00FF);
+
+		if (!filterByte(data)) {
+			rxBuffer.put(data);
+			throttleReception();
+		}
+	}
+
+	//Linha ociosa no modo DMA: fim de uma mensagem, lê o que chegou
+	flag = __HAL_UART_GET_FLAG(&huart, UART_FLAG_IDLE);
+	source = __HAL_UART_GET_IT_SOURCE(&huart, UART_IT_IDLE);
+	if ( (flag != RESET) && (source != RESET) ) {
+		__HAL_UART_CLEAR_IDLEFLAG(&huart);
+		receiveDma();
 	}
 }
 
+bool Serial::enableDmaReception(uint16_t size) {
+	if (error || (dmaBuffer != NULL) || (size < 2)) {
+		return false;
+	}
+
+	uint8_t index;
+	IRQn_Type irq;
+	if (huart.Instance == USART1) {
+		// USART1_RX: DMA2 Stream2 canal 4 (o Stream5 é do StepWaveform)
+		__HAL_RCC_DMA2_CLK_ENABLE();
+		hdmaRx.Instance = DMA2_Stream2;
+		hdmaRx.Init.Channel = DMA_CHANNEL_4;
+		irq = DMA2_Stream2_IRQn;
+		index = 1;
+	} else if (huart.Instance == USART2) {
+		// USART2_RX: DMA1 Stream5 canal 4
+		__HAL_RCC_DMA1_CLK_ENABLE();
+		hdmaRx.Instance = DMA1_Stream5;
+		hdmaRx.Init.Channel = DMA_CHANNEL_4;
+		irq = DMA1_Stream5_IRQn;
+		index = 0;
+	} else if (huart.Instance == USART6) {
+		// USART6_RX: DMA2 Stream2 canal 5 (o Stream1 é do StepWaveform)
+		__HAL_RCC_DMA2_CLK_ENABLE();
+		hdmaRx.Instance = DMA2_Stream2;
+		hdmaRx.Init.Channel = DMA_CHANNEL_5;
+		irq = DMA2_Stream2_IRQn;
+		index = 1;
+	} else {
+		return false;
+	}
+
+	if (dmaHandlers[index] != 0) {
+		return false;
+	}
+
+	dmaBuffer = new (std::nothrow) uint8_t[size];
+	if (dmaBuffer == NULL) {
+		return false;
+	}
+
+	hdmaRx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+	hdmaRx.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdmaRx.Init.MemInc = DMA_MINC_ENABLE;
+	hdmaRx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdmaRx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdmaRx.Init.Mode = DMA_CIRCULAR;
+	hdmaRx.Init.Priority = DMA_PRIORITY_HIGH;
+	hdmaRx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+
+	if (HAL_DMA_Init(&hdmaRx) != HAL_OK) {
+		delete[] dmaBuffer;
+		dmaBuffer = NULL;
+		return false;
+	}
+
+	hdmaRx.Parent = this;
+	hdmaRx.XferHalfCpltCallback = dmaRxCallback;
+	hdmaRx.XferCpltCallback = dmaRxCallback;
+	dmaHandlers[index] = this;
+
+	dmaSize = size;
+	dmaPosition = 0;
+
+	//Mesma prioridade da interrupção da serial, as duas leem o buffer do DMA
+	HAL_NVIC_SetPriority(irq, 3, 0);
+	HAL_NVIC_EnableIRQ(irq);
+
+	//Os bytes passam a ser copiados pelo DMA, a interrupção da serial só
+	//avisa quando a linha fica ociosa
+	__HAL_UART_DISABLE_IT(&huart, UART_IT_RXNE);
+	if (HAL_DMA_Start_IT(&hdmaRx, (uint32_t) &huart.Instance->DR, (uint32_t) dmaBuffer, size) != HAL_OK) {
+		__HAL_UART_ENABLE_IT(&huart, UART_IT_RXNE);
+		HAL_DMA_DeInit(&hdmaRx);
+		dmaHandlers[index] = 0;
+		delete[] dmaBuffer;
+		dmaBuffer = NULL;
+		return false;
+	}
+	SET_BIT(huart.Instance->CR3, USART_CR3_DMAR);
+
+	__HAL_UART_CLEAR_IDLEFLAG(&huart);
+	__HAL_UART_ENABLE_IT(&huart, UART_IT_IDLE);
+
+	return true;
+}
+
+void Serial::rxDmaInterrupt() {
+	HAL_DMA_IRQHandler(&hdmaRx);
+}
+
+void Serial::rxDmaCallback() {
+	//Metade ou fim do buffer escrito, chamado por HAL_DMA_IRQHandler
+	receiveDma();
+}
+
+void Serial::receiveDma() {
+	//O contador do DMA diz quantos bytes faltam até o fim do buffer
+	uint16_t head = dmaSize - __HAL_DMA_GET_COUNTER(&hdmaRx);
+	if (head >= dmaSize) {
+		head = 0;
+	}
+
+	while (dmaPosition != head) {
+		//Trecho contínuo do buffer do DMA
+		uint16_t end = (head > dmaPosition) ? head : dmaSize;
+		uint16_t start = dmaPosition;
+
+		//Comandos em tempo real e de fluxo não entram no buffer, os bytes
+		//entre eles são copiados em bloco
+		for (uint16_t i = start; i < end; i++) {
+			if (filterByte(dmaBuffer[i])) {
+				rxBuffer.write(&dmaBuffer[start], i - start);
+				start = i + 1;
+			}
+		}
+		rxBuffer.write(&dmaBuffer[start], end - start);
+
+		dmaPosition = (end == dmaSize) ? 0 : end;
+	}
+
+	throttleReception();
+}
+
+bool Serial::enableDmaTransmission(uint16_t size) {
+	if (error || (txBuffer != NULL) || (size < 2)) {
+		return false;
+	}
+
+	uint8_t index;
+	if (huart.Instance == USART1) {
+		// USART1_TX: DMA2 Stream7 canal 4
+		__HAL_RCC_DMA2_CLK_ENABLE();
+		hdmaTx.Instance = DMA2_Stream7;
+		hdmaTx.Init.Channel = DMA_CHANNEL_4;
+		txIrq = DMA2_Stream7_IRQn;
+		index = 0;
+	} else if (huart.Instance == USART2) {
+		// USART2_TX: DMA1 Stream6 canal 4
+		__HAL_RCC_DMA1_CLK_ENABLE();
+		hdmaTx.Instance = DMA1_Stream6;
+		hdmaTx.Init.Channel = DMA_CHANNEL_4;
+		txIrq = DMA1_Stream6_IRQn;
+		index = 1;
+	} else if (huart.Instance == USART6) {
+		// USART6_TX: DMA2 Stream6 canal 5
+		__HAL_RCC_DMA2_CLK_ENABLE();
+		hdmaTx.Instance = DMA2_Stream6;
+		hdmaTx.Init.Channel = DMA_CHANNEL_5;
+		txIrq = DMA2_Stream6_IRQn;
+		index = 2;
+	} else {
+		return false;
+	}
+
+	txBuffer = new (std::nothrow) uint8_t[size];
+	if (txBuffer == NULL) {
+		return false;
+	}
+
+	hdmaTx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+	hdmaTx.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdmaTx.Init.MemInc = DMA_MINC_ENABLE;
+	hdmaTx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdmaTx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdmaTx.Init.Mode = DMA_NORMAL;
+	hdmaTx.Init.Priority = DMA_PRIORITY_LOW;
+	hdmaTx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+
+	if (HAL_DMA_Init(&hdmaTx) != HAL_OK) {
+		delete[] txBuffer;
+		txBuffer = NULL;
+		return false;
+	}
+
+	//Erros também encerram a transferência, senão a fila pararia
+	hdmaTx.Parent = this;
+	hdmaTx.XferCpltCallback = dmaTxCallback;
+	hdmaTx.XferErrorCallback = dmaTxCallback;
+	hdmaTx.XferHalfCpltCallback = NULL;
+	hdmaTx.XferAbortCallback = NULL;
+	dmaTxHandlers[index] = this;
+
+	txSize = size;
+	txHead = 0;
+	txTail = 0;
+	txLength = 0;
+	txOverflows = 0;
+
+	//Espera o fim de alguma transmissão bloqueante antes de passar a UART ao DMA
+	while (__HAL_UART_GET_FLAG(&huart, UART_FLAG_TC) == RESET);
+	SET_BIT(huart.Instance->CR3, USART_CR3_DMAT);
+
+	HAL_NVIC_SetPriority(txIrq, 3, 0);
+	HAL_NVIC_EnableIRQ(txIrq);
+
+	return true;
+}
+
+void Serial::txDmaInterrupt() {
+	HAL_DMA_IRQHandler(&hdmaTx);
+}
+
+void Serial::txDmaCallback() {
+	//Um erro de FIFO não para o stream, a transferência continua
+	if (hdmaTx.State != HAL_DMA_STATE_READY) {
+		return;
+	}
+
+	if (txFlowSending) {
+		txFlowSending = false;
+	} else {
+		uint16_t tail = txTail + txLength;
+		if (tail >= txSize) {
+			tail -= txSize;
+		}
+		txTail = tail;
+	}
+	txLength = 0;
+
+	startTransmit();
+}
+
+void Serial::startTransmit() {
+	if (txLength != 0) {
+		return;
+	}
+
+	//XON e XOFF passam na frente da fila, mesmo com a transmissão pausada
+	if (txFlowByte != 0) {
+		txFlowBuffer = txFlowByte;
+		txFlowByte = 0;
+		txFlowSending = true;
+		txLength = 1;
+
+		if (HAL_DMA_Start_IT(&hdmaTx, (uint32_t) &txFlowBuffer, (uint32_t) &huart.Instance->DR, 1) != HAL_OK) {
+			txFlowSending = false;
+			txLength = 0;
+		}
+		return;
+	}
+
+	uint16_t head = txHead;
+	uint16_t tail = txTail;
+	if (txPaused || (head == tail)) {
+		return;
+	}
+
+	//Só o trecho até o fim do buffer, o resto vai na próxima transferência
+	uint16_t length = (head > tail) ? head - tail : txSize - tail;
+	if ( (flowControl == SERIAL_FLOW_XON_XOFF) && (length > SERIAL_FLOW_CHUNK) ) {
+		length = SERIAL_FLOW_CHUNK;
+	}
+	txLength = length;
+
+	if (HAL_DMA_Start_IT(&hdmaTx, (uint32_t) &txBuffer[tail], (uint32_t) &huart.Instance->DR, length) != HAL_OK) {
+		txLength = 0;
+	}
+}
+
+size_t Serial::txFree() {
+	if (txBuffer == NULL) {
+		return 0;
+	}
+
+	//Um byte fica sempre vazio para distinguir fila cheia de fila vazia
+	uint16_t head = txHead;
+	uint16_t tail = txTail;
+	return (tail > head) ? tail - head - 1 : txSize - (head - tail) - 1;
+}
+
+uint32_t Serial::getTxOverflows() {
+	return (txBuffer == NULL) ? 0 : txOverflows;
+}
+
+bool Serial::enableFlowControl(uint8_t mode) {
+	if (error || (flowControl != SERIAL_FLOW_NONE)) {
+		return false;
+	}
+
+	if (mode == SERIAL_FLOW_RTS_CTS) {
+		uint8_t alternate;
+		if (huart.Instance == USART1) {
+			// PA11    ------> USART1_CTS
+			// PA12    ------> RTS
+			flowPort = GPIOA;
+			ctsPin = GPIO_PIN_11;
+			rtsPin = GPIO_PIN_12;
+			alternate = GPIO_AF7_USART1;
+		} else if (huart.Instance == USART2) {
+			// PA0     ------> USART2_CTS
+			// PA1     ------> RTS
+			flowPort = GPIOA;
+			ctsPin = GPIO_PIN_0;
+			rtsPin = GPIO_PIN_1;
+			alternate = GPIO_AF7_USART2;
+		} else {
+			return false;
+		}
+
+		//CTS desconectado fica em nível baixo e não trava a transmissão
+		GPIO_InitTypeDef GPIO_InitStruct;
+		GPIO_InitStruct.Pin = ctsPin;
+		GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+		GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+		GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+		GPIO_InitStruct.Alternate = alternate;
+		HAL_GPIO_Init(flowPort, &GPIO_InitStruct);
+
+		//O RTS do hardware só sobe com um byte parado no DR, o que com o DMA
+		//não acontece. Ele é controlado pelo nível do buffer de recepção
+		HAL_GPIO_WritePin(flowPort, rtsPin, GPIO_PIN_RESET);
+		GPIO_InitStruct.Pin = rtsPin;
+		GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+		GPIO_InitStruct.Pull = GPIO_NOPULL;
+		GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+		GPIO_InitStruct.Alternate = 0;
+		HAL_GPIO_Init(flowPort, &GPIO_InitStruct);
+
+		__HAL_UART_DISABLE(&huart);
+		SET_BIT(huart.Instance->CR3, USART_CR3_CTSE);
+		__HAL_UART_ENABLE(&huart);
+
+	} else if (mode == SERIAL_FLOW_XON_XOFF) {
+		//XON e XOFF são enviados pela interrupção, sem esperar a fila
+		if (txBuffer == NULL) {
+			return false;
+		}
+
+	} else {
+		return false;
+	}
+
+	//Bytes que já estavam no buffer também contam
+	__disable_irq();
+	rxThrottled = false;
+	txPaused = false;
+	txFlowByte = 0;
+	flowControl = mode;
+	throttleReception();
+	__enable_irq();
+
+	return true;
+}
+
+bool Serial::filterByte(uint8_t data) {
+	if (flowControl == SERIAL_FLOW_XON_XOFF) {
+		if (data == SERIAL_XOFF) {
+			txPaused = true;
+			return true;
+		}
+
+		if (data == SERIAL_XON) {
+			txPaused = false;
+			startTransmit();
+			return true;
+		}
+	}
+
+	//Comandos em tempo real não esperam o loop principal
+	return (realtimeHandler != NULL) && realtimeHandler(data);
+}
+
+void Serial::throttleReception() {
+	if ( (flowControl == SERIAL_FLOW_NONE) || rxThrottled || (rxBuffer.size() < SERIAL_FLOW_HIGH_WATER) ) {
+		return;
+	}
+
+	rxThrottled = true;
+	if (flowControl == SERIAL_FLOW_RTS_CTS) {
+		HAL_GPIO_WritePin(flowPort, rtsPin, GPIO_PIN_SET);
+	} else {
+		txFlowByte = SERIAL_XOFF;
+		startTransmit();
+	}
+}
+
+void Serial::releaseReception() {
+	if (!rxThrottled || (rxBuffer.size() > SERIAL_FLOW_LOW_WATER)) {
+		return;
+	}
+
+	//A interrupção de recepção pode ter mandado parar de novo entre o teste e aqui
+	__disable_irq();
+	if (rxThrottled && (rxBuffer.size() <= SERIAL_FLOW_LOW_WATER)) {
+		rxThrottled = false;
+		if (flowControl == SERIAL_FLOW_RTS_CTS) {
+			HAL_GPIO_WritePin(flowPort, rtsPin, GPIO_PIN_RESET);
+		} else {
+			txFlowByte = SERIAL_XON;
+			startTransmit();
+		}
+	}
+	__enable_irq();
+}
+
+uint32_t Serial::getRxOverflows() {
+	return rxBuffer.overflows();
+}
+
+void Serial::setRealtimeHandler(bool (*handler)(uint8_t data)) {
+	realtimeHandler = handler;
+}
+
 //Interruption callbacks
 extern "C" {
 	void USART1_IRQHandler() {
@@ -421,3 +837,43 @@ extern "C" {
 		}
 	}
 }
+
+extern "C" {
+	void DMA1_Stream5_IRQHandler() {
+		if (dmaHandlers[0] != 0) {
+			dmaHandlers[0]->rxDmaInterrupt();
+		}
+	}
+}
+
+extern "C" {
+	void DMA2_Stream2_IRQHandler() {
+		if (dmaHandlers[1] != 0) {
+			dmaHandlers[1]->rxDmaInterrupt();
+		}
+	}
+}
+
+extern "C" {
+	void DMA2_Stream7_IRQHandler() {
+		if (dmaTxHandlers[0] != 0) {
+			dmaTxHandlers[0]->txDmaInterrupt();
+		}
+	}
+}
+
+extern "C" {
+	void DMA1_Stream6_IRQHandler() {
+		if (dmaTxHandlers[1] != 0) {
+			dmaTxHandlers[1]->txDmaInterrupt();
+		}
+	}
+}
+
+extern "C" {
+	void DMA2_Stream6_IRQHandler() {
+		if (dmaTxHandlers[2] != 0) {
+			dmaTxHandlers[2]->txDmaInterrupt();
+		}
+	}
+}
@@ -0,0 +1,1423 @@
+/*
+ * StepGenerator.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <StepGenerator.h>
+
+#include <cmath>
+
+#include "FastMath.h"
+#include "StepWaveform.h"
+
+#define TIMER_NUMBER 2
+
+StepGenerator* timerHandlers[TIMER_NUMBER] = {0};
+
+/**
+ * Construtor
+ *
+ * instance				Timer de 32 bits a ser utilizado (TIM2 ou TIM5)
+ * planner				Fila de blocos a ser executada
+ * xAxis				Motor do eixo X
+ * yAxis				Motor do eixo Y
+ */
+StepGenerator::StepGenerator(TIM_TypeDef* instance, Planner* planner, Stepper* xAxis, Stepper* yAxis) {
+	error = true;
+
+	this->planner = planner;
+	axis[X_AXIS] = xAxis;
+	axis[Y_AXIS] = yAxis;
+
+	waveform = NULL;
+	periodTable = NULL;
+	periodTableSize = 0;
+	running = false;
+	stepPeriod = STEP_TIMER_FREQUENCY / 1000;
+
+	segmentHead = 0;
+	segmentTail = 0;
+	segment = NULL;
+	block = NULL;
+	blockIndex = 0xFF;
+	segmentSteps = 0;
+
+	prepBlock = NULL;
+	prepBlockIndex = 0;
+	prepSteps = 0;
+	prepTime = 0.0f;
+	prepPosition = 0.0f;
+	prepSpeed = 0.0f;
+	replanEntry = false;
+
+	profileStart = 0.0f;
+	profileEnd = 0.0f;
+	initialRate = 0.0f;
+	peakRate = 0.0f;
+	finalRate = 0.0f;
+	accelerationSteps = 0.0f;
+	cruiseSteps = 0.0f;
+	accelerationTime = 0.0f;
+	cruiseTime = 0.0f;
+	decelerationTime = 0.0f;
+
+	holdRequest = false;
+	resumeRequest = false;
+	feedOverride = 100;
+	appliedOverride = 100;
+	state = STEP_STATE_CYCLE;
+
+	stopped = false;
+	armedEndstops = 0;
+	triggeredEndstops = 0;
+	hardLimits = 0;
+	alarm = false;
+
+	velocityMode = false;
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		velocityTarget[i] = 0.0f;
+		velocityRate[i] = 0.0f;
+		velocityAcceleration[i] = 0.0f;
+		velocityPosition[i] = 0.0f;
+		velocitySteps[i] = 0;
+		pvtSteps[i] = 0;
+	}
+	pvtTime = 0.0f;
+	pvtScale = 1.0f;
+
+	//Direção inválida força a escrita dos pinos no primeiro bloco
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		position[i] = 0;
+		direction[i] = 0xFF;
+	}
+
+	IRQn_Type irq;
+
+	if (instance == TIM2) {
+		__HAL_RCC_TIM2_CLK_ENABLE();
+		timerHandlers[0] = this;
+		irq = TIM2_IRQn;
+	} else if (instance == TIM5) {
+		__HAL_RCC_TIM5_CLK_ENABLE();
+		timerHandlers[1] = this;
+		irq = TIM5_IRQn;
+	} else {
+		return;
+	}
+
+	//Os timers da APB1 recebem o dobro do clock do barramento quando há divisor
+	uint32_t timerClock = HAL_RCC_GetPCLK1Freq();
+	if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+		timerClock *= 2;
+	}
+
+	htim.Instance = instance;
+	htim.Init.Prescaler = (timerClock / STEP_TIMER_FREQUENCY) - 1;
+	htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim.Init.Period = 0xFFFF;
+	htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim.Init.RepetitionCounter = 0;
+	if (HAL_TIM_Base_Init(&htim) != HAL_OK) {
+		return;
+	}
+
+	//Período novo só é carregado no próximo evento de update
+	htim.Instance->CR1 |= TIM_CR1_ARPE;
+	htim.Instance->SR = ~TIM_SR_UIF;
+	htim.Instance->DIER |= TIM_DIER_UIE;
+
+	//Prioridade maior que a da serial, para manter a temporização dos passos
+	HAL_NVIC_SetPriority(irq, 1, 0);
+	HAL_NVIC_EnableIRQ(irq);
+
+	error = false;
+}
+
+/**
+ * Destrutor
+ */
+StepGenerator::~StepGenerator() {
+	if (!error) {
+		htim.Instance->CR1 &= ~TIM_CR1_CEN;
+		htim.Instance->DIER &= ~TIM_DIER_UIE;
+
+		if (htim.Instance == TIM2) {
+			HAL_NVIC_DisableIRQ(TIM2_IRQn);
+			__HAL_RCC_TIM2_CLK_DISABLE();
+			timerHandlers[0] = 0;
+		} else if (htim.Instance == TIM5) {
+			HAL_NVIC_DisableIRQ(TIM5_IRQn);
+			__HAL_RCC_TIM5_CLK_DISABLE();
+			timerHandlers[1] = 0;
+		}
+
+		error = true;
+	}
+}
+
+/**
+ * Retorna true se houver algum bloco em execução ou na fila
+ */
+bool StepGenerator::busy() {
+	//Na saída por DMA os últimos passos ainda estão no buffer
+	if (waveform != NULL && waveform->playing()) {
+		return true;
+	}
+
+	//Fila interrompida só volta a ser executada depois do reset
+	if (stopped) {
+		return false;
+	}
+
+	return running || (segmentHead != segmentTail) || (prepBlock != NULL) || !planner->empty()
+			|| velocityActive();
+}
+
+/**
+ * Aguarda até que todos os blocos da fila sejam executados
+ */
+void StepGenerator::synchronize() {
+	while (busy()) {
+		wakeUp();
+	}
+}
+
+/**
+ * Pede a parada dos eixos com desaceleração controlada, mantendo a fila.
+ * Pode ser chamado pela interrupção da serial
+ */
+void StepGenerator::feedHold() {
+	holdRequest = true;
+}
+
+/**
+ * Retoma a execução após um feed hold. Pode ser chamado pela interrupção
+ * da serial
+ */
+void StepGenerator::cycleStart() {
+	resumeRequest = true;
+}
+
+/**
+ * Define o override de velocidade, aplicado inclusive ao bloco em execução.
+ * Pode ser chamado pela interrupção da serial
+ *
+ * percent				Porcentagem da velocidade programada, de FEED_OVERRIDE_MIN a FEED_OVERRIDE_MAX
+ */
+void StepGenerator::setFeedOverride(uint16_t percent) {
+	if (percent < FEED_OVERRIDE_MIN) {
+		percent = FEED_OVERRIDE_MIN;
+	} else if (percent > FEED_OVERRIDE_MAX) {
+		percent = FEED_OVERRIDE_MAX;
+	}
+
+	feedOverride = percent;
+}
+
+/**
+ * Retorna o override de velocidade em %
+ */
+uint16_t StepGenerator::getFeedOverride() {
+	return feedOverride;
+}
+
+/**
+ * Retorna true se a execução estiver em feed hold
+ */
+bool StepGenerator::isHeld() {
+	return state == STEP_STATE_HOLD;
+}
+
+/**
+ * Define a velocidade de um eixo no modo de velocidade. O eixo acelera
+ * até ela e gira até receber outra, zero para e sai do modo quando
+ * todos os eixos estiverem parados. O modo começa quando a fila do
+ * planejador termina
+ *
+ * axis					Índice do eixo
+ * speed				Velocidade em graus/s, negativa para girar ao contrário
+ */
+void StepGenerator::setVelocity(uint8_t axis, float speed) {
+	if (axis >= N_AXIS) {
+		return;
+	}
+
+	float maxSpeed = planner->getMaxSpeed(axis);
+	if (speed > maxSpeed) {
+		speed = maxSpeed;
+	} else if (speed < -maxSpeed) {
+		speed = -maxSpeed;
+	}
+
+	//Taxas muito baixas levariam minutos para um passo
+	float stepsPerDegree = planner->getStepsPerDegree(axis);
+	float rate = speed * stepsPerDegree;
+	if (fabsf(rate) < VELOCITY_MIN_RATE) {
+		rate = 0.0f;
+	}
+
+	velocityAcceleration[axis] = planner->getAcceleration(axis) * stepsPerDegree;
+	velocityTarget[axis] = rate;
+}
+
+/**
+ * Retorna true se algum eixo estiver girando ou com velocidade pedida
+ * no modo de velocidade
+ */
+bool StepGenerator::velocityActive() {
+	if (velocityMode) {
+		return true;
+	}
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		if (velocityTarget[i] != 0.0f) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Interrompe a geração de passos imediatamente, sem desaceleração. A
+ * posição continua válida, mas a fila só volta a ser executada depois
+ * de reset(). Pode ser chamado por interrupções
+ */
+void StepGenerator::stop() {
+	stopped = true;
+
+	//Na saída por DMA os eventos já calculados, no máximo meio buffer, ainda
+	//são escritos nas portas e já estão contados na posição
+	if (waveform == NULL) {
+		htim.Instance->CR1 &= ~TIM_CR1_CEN;
+		running = false;
+	}
+}
+
+/**
+ * Retorna true se a geração de passos foi interrompida por stop()
+ */
+bool StepGenerator::isStopped() {
+	return stopped;
+}
+
+/**
+ * Descarta os segmentos e os blocos do planejador e volta a aceitar
+ * movimentos a partir da posição real dos eixos
+ */
+void StepGenerator::reset() {
+	stop();
+
+	//Espera os últimos eventos calculados saírem pelo DMA
+	while (waveform != NULL && waveform->playing());
+
+	__disable_irq();
+	segment = NULL;
+	block = NULL;
+	blockIndex = 0xFF;
+	segmentTail = segmentHead;
+	running = false;
+	__enable_irq();
+
+	prepBlock = NULL;
+	prepSteps = 0;
+	prepSpeed = 0.0f;
+	replanEntry = false;
+
+	holdRequest = false;
+	resumeRequest = false;
+	state = STEP_STATE_CYCLE;
+
+	velocityMode = false;
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		velocityTarget[i] = 0.0f;
+		velocityRate[i] = 0.0f;
+		velocityPosition[i] = 0.0f;
+		velocitySteps[i] = 0;
+		pvtSteps[i] = 0;
+	}
+	pvtTime = 0.0f;
+	pvtScale = 1.0f;
+
+	//Planejador continua da posição em que os eixos pararam
+	int32_t current[N_AXIS];
+	getPosition(current);
+	planner->clear();
+	planner->setPosition(current);
+
+	stopped = false;
+}
+
+/**
+ * Define os eixos cujos fins de curso interrompem o movimento e limpa os
+ * acionamentos anteriores
+ *
+ * axes					Um bit por eixo
+ */
+void StepGenerator::armEndstops(uint8_t axes) {
+	__disable_irq();
+	armedEndstops = axes;
+	triggeredEndstops = 0;
+	__enable_irq();
+}
+
+/**
+ * Informa o acionamento do fim de curso de um eixo. Chamado pela
+ * interrupção do pino, para a geração de passos se o eixo estiver armado
+ *
+ * axis					Índice do eixo
+ */
+void StepGenerator::endstopEvent(uint8_t axis) {
+	uint8_t mask = 1 << axis;
+
+	if (armedEndstops & mask) {
+		triggeredEndstops |= mask;
+		stop();
+	} else if (hardLimits & mask) {
+		//Limite físico: nem os passos já calculados para o DMA são escritos
+		alarm = true;
+		stop();
+		if (waveform != NULL) {
+			waveform->abort();
+		}
+	}
+}
+
+/**
+ * Retorna os eixos armados cujo fim de curso foi acionado, um bit por eixo
+ */
+uint8_t StepGenerator::getTriggeredEndstops() {
+	return triggeredEndstops;
+}
+
+/**
+ * Define os eixos com limite físico. Fora do homing, o acionamento do fim
+ * de curso de um deles descarta inclusive os passos já calculados e
+ * coloca o gerador em alarme
+ *
+ * axes					Um bit por eixo
+ */
+void StepGenerator::setHardLimits(uint8_t axes) {
+	hardLimits = axes;
+}
+
+/**
+ * Retorna true se o gerador estiver em alarme por um limite físico
+ */
+bool StepGenerator::inAlarm() {
+	return alarm;
+}
+
+/**
+ * Sai do alarme descartando a fila, como em reset(). A posição continua
+ * a contada em passos, que pode ter sido perdida na parada
+ */
+void StepGenerator::clearAlarm() {
+	reset();
+	alarm = false;
+}
+
+/**
+ * Retorna a posição real dos eixos em passos
+ *
+ * position				Array onde a posição de cada eixo será escrita
+ */
+void StepGenerator::getPosition(int32_t position[N_AXIS]) {
+	//Cópia consistente entre os eixos
+	__disable_irq();
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		position[i] = this->position[i];
+	}
+	__enable_irq();
+}
+
+/**
+ * Define a posição real dos eixos sem movimentá-los. Só deve ser chamado
+ * com os motores parados
+ *
+ * position				Posição de cada eixo em passos
+ */
+void StepGenerator::setPosition(const int32_t position[N_AXIS]) {
+	__disable_irq();
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		this->position[i] = position[i];
+	}
+	__enable_irq();
+}
+
+/**
+ * Divide os blocos do planejador em segmentos até encher o buffer. Não
+ * usa a interrupção, deve ser chamado pelo loop principal
+ */
+void StepGenerator::prepare() {
+	if (stopped) {
+		return;
+	}
+
+	//Feed hold: desacelera a partir da velocidade atual, sem esperar o fim do bloco
+	if (holdRequest) {
+		holdRequest = false;
+
+		if (state == STEP_STATE_CYCLE) {
+			state = STEP_STATE_HOLD;
+			if ((prepBlock != NULL) && !prepBlock->pvt && (prepPosition < profileEnd)) {
+				replanHold(profileRate(prepTime));
+			}
+		}
+	}
+
+	//Retomada só depois que os eixos pararam
+	if (resumeRequest) {
+		bool halted = (prepBlock == NULL)
+				|| (prepBlock->pvt ? (pvtScale == 0.0f) : (prepPosition >= profileEnd));
+
+		if (state == STEP_STATE_CYCLE) {
+			resumeRequest = false;
+		} else if (halted && (segmentHead == segmentTail)) {
+			resumeRequest = false;
+			state = STEP_STATE_CYCLE;
+
+			//Pontos PVT voltam a acelerar o tempo da trajetória sozinhos
+			if ((prepBlock != NULL) && !prepBlock->pvt) {
+				profileEnd = prepBlock->stepEventCount;
+				replanToExit(MINIMUM_STEP_RATE);
+			} else if (prepBlock == NULL) {
+				prepSpeed = 0.0f;
+				replanEntry = true;
+			}
+		}
+	}
+
+	//Override aplicado à fila e ao restante do bloco em preparação
+	if (appliedOverride != feedOverride) {
+		appliedOverride = feedOverride;
+		planner->setFeedOverride(appliedOverride);
+
+		if ((state == STEP_STATE_CYCLE) && (prepBlock != NULL) && !prepBlock->pvt) {
+			replanToExit(profileRate(prepTime));
+		}
+	}
+
+	//Modo de velocidade só começa depois do último bloco da fila
+	if (!velocityMode && (prepBlock == NULL) && planner->empty() && velocityActive()) {
+		velocityMode = true;
+	}
+
+	if (velocityMode) {
+		prepareVelocity();
+		return;
+	}
+
+	while (nextSegment(segmentHead) != segmentTail) {
+		if (prepBlock == NULL) {
+			if (!loadPrepBlock()) {
+				return;
+			}
+		}
+
+		if (prepBlock->pvt) {
+			if (!preparePvtSegment()) {
+				return;
+			}
+			continue;
+		}
+
+		//Perfil terminou antes do bloco, eixos parados pelo feed hold
+		if (prepPosition >= profileEnd) {
+			return;
+		}
+
+		uint32_t stepEventCount = prepBlock->stepEventCount;
+		float startTime = prepTime;
+		float profileTime = accelerationTime + cruiseTime + decelerationTime;
+		uint32_t steps = 0;
+		bool fullSegment = true;
+
+		//Segmentos de duração fixa, estendidos se a velocidade for baixa demais
+		//para um passo inteiro. O último termina junto com o perfil
+		while (steps == 0) {
+			if (prepTime > startTime) {
+				fullSegment = false;
+			}
+			prepTime += SEGMENT_TIME;
+			prepPosition = profilePosition(prepTime);
+
+			if ((prepTime >= profileTime) || (prepPosition >= profileEnd)) {
+				//Segmento final mais curto, termina junto com o perfil
+				if (prepTime > profileTime) {
+					prepTime = profileTime;
+				}
+				prepPosition = profileEnd;
+				steps = (uint32_t) ceilf(profileEnd) - prepSteps;
+				fullSegment = false;
+				break;
+			}
+
+			steps = (uint32_t) prepPosition - prepSteps;
+		}
+
+		if (steps == 0) {
+			return;
+		}
+
+		//Os passos do segmento são distribuídos por toda a sua duração, a fração
+		//de passo que sobra vai para o segmento seguinte
+		StepPeriod timing = segmentTiming(steps, prepTime - startTime, fullSegment);
+
+		StepSegment* next = &segments[segmentHead];
+		next->steps = steps << timing.level;
+		next->period = timing.period;
+		next->block = prepBlockIndex;
+		next->level = timing.level;
+
+		//Segmento só fica visível para a interrupção depois de completo
+		segmentHead = nextSegment(segmentHead);
+
+		prepSteps += steps;
+		if (prepSteps >= stepEventCount) {
+			//Velocidade com que o próximo bloco começa se o perfil dele for refeito
+			prepSpeed = finalRate * prepBlock->distance / stepEventCount;
+			prepBlock = NULL;
+			planner->discardCurrentBlock();
+		}
+	}
+}
+
+/**
+ * Prepara segmentos do modo de velocidade, acelerando cada eixo até a
+ * taxa pedida. Sai do modo quando todos os eixos param sem nova taxa
+ */
+void StepGenerator::prepareVelocity() {
+	while (nextSegment(segmentHead) != segmentTail) {
+		int32_t steps[N_AXIS];
+		uint32_t events = 0;
+		float duration = 0.0f;
+		uint8_t periods = 0;
+
+		//Segmentos de duração fixa, estendidos se a taxa for baixa demais
+		//para um passo inteiro, até VELOCITY_MAX_SEGMENTS vezes. Um segmento
+		//sem passos só marca o tempo
+		while ((events == 0) && (periods < VELOCITY_MAX_SEGMENTS)) {
+			bool moving = false;
+			duration += SEGMENT_TIME;
+			periods++;
+
+			for (uint8_t i = 0; i < N_AXIS; i++) {
+				//No feed hold todos os eixos desaceleram até parar
+				float target = (state == STEP_STATE_HOLD) ? 0.0f : velocityTarget[i];
+				float change = velocityAcceleration[i] * SEGMENT_TIME;
+				float previous = velocityRate[i];
+
+				if (velocityRate[i] < target) {
+					velocityRate[i] = fminf(velocityRate[i] + change, target);
+				} else {
+					velocityRate[i] = fmaxf(velocityRate[i] - change, target);
+				}
+
+				//Na rampa linear a distância é a taxa média vezes o tempo
+				velocityPosition[i] += 0.5f * (previous + velocityRate[i]) * SEGMENT_TIME;
+				steps[i] = (int32_t) velocityPosition[i] - velocitySteps[i];
+
+				if ((uint32_t) abs(steps[i]) > events) {
+					events = abs(steps[i]);
+				}
+				if ((previous != 0.0f) || (velocityRate[i] != 0.0f)) {
+					moving = true;
+				}
+			}
+
+			//Todos os eixos parados: sai do modo se nenhuma taxa foi pedida,
+			//senão está em feed hold e espera a retomada
+			if (!moving) {
+				bool requested = false;
+				for (uint8_t i = 0; i < N_AXIS; i++) {
+					requested = requested || (velocityTarget[i] != 0.0f);
+				}
+
+				if (!requested) {
+					//Planejador continua de onde os eixos pararam
+					int32_t position[N_AXIS];
+					planner->getPosition(position);
+					for (uint8_t i = 0; i < N_AXIS; i++) {
+						position[i] += velocitySteps[i];
+						velocityPosition[i] = 0.0f;
+						velocitySteps[i] = 0;
+					}
+					planner->setPosition(position);
+					velocityMode = false;
+				}
+				return;
+			}
+		}
+
+		for (uint8_t i = 0; i < N_AXIS; i++) {
+			velocitySteps[i] += steps[i];
+		}
+		queueSegment(steps, duration, duration == SEGMENT_TIME);
+	}
+}
+
+/**
+ * Prepara um segmento de duração SEGMENT_TIME de uma sequência de pontos
+ * PVT, passando para o ponto seguinte quando o atual termina. Retorna
+ * false se os eixos estiverem parados pelo feed hold
+ */
+bool StepGenerator::preparePvtSegment() {
+	//No feed hold o tempo da trajetória desacelera até parar, sem que a
+	//desaceleração de algum eixo passe da aceleração dele
+	float previousScale = pvtScale;
+	float targetScale = (state == STEP_STATE_HOLD) ? 0.0f : 1.0f;
+
+	if (pvtScale != targetScale) {
+		float change = 1.0f;
+		for (uint8_t i = 0; i < N_AXIS; i++) {
+			float rate = fabsf(pvtRate(i, pvtTime));
+			if (rate > 0.0f) {
+				float acceleration = planner->getAcceleration(i) * planner->getStepsPerDegree(i);
+				change = fminf(change, acceleration / rate * SEGMENT_TIME);
+			}
+		}
+
+		if (pvtScale < targetScale) {
+			pvtScale = fminf(pvtScale + change, targetScale);
+		} else {
+			pvtScale = fmaxf(pvtScale - change, targetScale);
+		}
+	}
+
+	if ((previousScale == 0.0f) && (pvtScale == 0.0f)) {
+		return false;
+	}
+
+	int32_t steps[N_AXIS];
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		steps[i] = 0;
+	}
+
+	float duration = SEGMENT_TIME;
+	float advance = 0.5f * (previousScale + pvtScale) * SEGMENT_TIME;
+	pvtTime += advance;
+
+	//Segmento que passa do fim do ponto continua no seguinte, assim a
+	//trajetória não para entre os pontos
+	while (pvtTime >= prepBlock->pvtDuration) {
+		float rate[N_AXIS];
+		for (uint8_t i = 0; i < N_AXIS; i++) {
+			int32_t total = (prepBlock->direction[i] == CW) ? prepBlock->steps[i] : -(int32_t) prepBlock->steps[i];
+			steps[i] += total - pvtSteps[i];
+			pvtSteps[i] = 0;
+			rate[i] = prepBlock->pvtExitRate[i];
+		}
+		pvtTime -= prepBlock->pvtDuration;
+
+		//A desaceleração não está na fila do planejador
+		bool stopping = (prepBlock == &pvtStop);
+		if (!stopping) {
+			planner->discardCurrentBlock();
+		}
+		prepBlock = planner->currentBlock();
+
+		//Fila vazia com os eixos em movimento: em vez de parar de uma vez eles
+		//desaceleram a partir da taxa do último ponto
+		if ((prepBlock == NULL) && !stopping && loadPvtStop(rate)) {
+			prepBlock = &pvtStop;
+		}
+
+		if ((prepBlock == NULL) || !prepBlock->pvt) {
+			//Fim da sequência, o segmento termina junto com o último ponto
+			duration -= SEGMENT_TIME * pvtTime / advance;
+			pvtTime = 0.0f;
+			pvtScale = 1.0f;
+			prepSpeed = 0.0f;
+			prepBlock = NULL;
+			break;
+		}
+
+		prepBlock->busy = true;
+	}
+
+	if (prepBlock != NULL) {
+		for (uint8_t i = 0; i < N_AXIS; i++) {
+			int32_t position = (int32_t) pvtPosition(i, pvtTime);
+			steps[i] += position - pvtSteps[i];
+			pvtSteps[i] = position;
+		}
+	}
+
+	queueSegment(steps, duration, duration == SEGMENT_TIME);
+
+	return true;
+}
+
+/**
+ * Prepara em pvtStop a desaceleração dos eixos quando a fila esvazia no
+ * meio de uma sequência PVT. Todos param juntos, no tempo do eixo que leva
+ * mais para parar na própria aceleração. Retorna false se os eixos já
+ * estiverem parados
+ *
+ * rate					Taxa de cada eixo no último ponto em passos/s, com sinal
+ */
+bool StepGenerator::loadPvtStop(const float rate[N_AXIS]) {
+	float duration = 0.0f;
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		float acceleration = planner->getAcceleration(i) * planner->getStepsPerDegree(i);
+		duration = fmaxf(duration, fabsf(rate[i]) / acceleration);
+	}
+
+	if (duration == 0.0f) {
+		return false;
+	}
+
+	//Com taxa final zero a cúbica é uma desaceleração constante, que anda
+	//metade do que andaria na taxa inicial. A posição do planejador passa a
+	//ser o ponto de parada, e um ponto novo parte dele e do repouso
+	int32_t position[N_AXIS];
+	planner->getPosition(position);
+
+	pvtStop.stepEventCount = 0;
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		int32_t distance = lroundf(0.5f * rate[i] * duration);
+		pvtStop.steps[i] = abs(distance);
+		pvtStop.direction[i] = (distance < 0) ? CCW : CW;
+		pvtStop.pvtEntryRate[i] = rate[i];
+		pvtStop.pvtExitRate[i] = 0.0f;
+		if (pvtStop.steps[i] > pvtStop.stepEventCount) {
+			pvtStop.stepEventCount = pvtStop.steps[i];
+		}
+		position[i] += distance;
+	}
+	pvtStop.pvt = true;
+	pvtStop.pvtDuration = duration;
+	planner->setPosition(position);
+
+	return true;
+}
+
+/**
+ * Retorna a posição de um eixo na cúbica do ponto PVT em preparação, em
+ * passos com sinal desde o início do ponto
+ *
+ * axis					Índice do eixo
+ * time					Tempo desde o início do ponto em s
+ */
+float StepGenerator::pvtPosition(uint8_t axis, float time) {
+	float duration = prepBlock->pvtDuration;
+	float distance = (prepBlock->direction[axis] == CW) ? prepBlock->steps[axis] : -(float) prepBlock->steps[axis];
+	float u = time / duration;
+
+	//Cúbica de Hermite entre as posições e as taxas dos dois pontos
+	float entry = u * (u - 1.0f) * (u - 1.0f);
+	float target = u * u * (3.0f - 2.0f * u);
+	float exit = u * u * (u - 1.0f);
+
+	return entry * duration * prepBlock->pvtEntryRate[axis] + target * distance
+			+ exit * duration * prepBlock->pvtExitRate[axis];
+}
+
+/**
+ * Retorna a taxa de um eixo na cúbica do ponto PVT em preparação em
+ * passos/s, com sinal
+ *
+ * axis					Índice do eixo
+ * time					Tempo desde o início do ponto em s
+ */
+float StepGenerator::pvtRate(uint8_t axis, float time) {
+	float duration = prepBlock->pvtDuration;
+	float distance = (prepBlock->direction[axis] == CW) ? prepBlock->steps[axis] : -(float) prepBlock->steps[axis];
+	float u = time / duration;
+
+	//Derivada da cúbica de pvtPosition
+	float entry = (3.0f * u - 1.0f) * (u - 1.0f);
+	float target = 6.0f * u * (1.0f - u);
+	float exit = u * (3.0f * u - 2.0f);
+
+	return entry * prepBlock->pvtEntryRate[axis] + target * distance / duration
+			+ exit * prepBlock->pvtExitRate[axis];
+}
+
+/**
+ * Coloca no buffer um segmento com o próprio bloco, usado quando os eixos
+ * podem mudar de direção a cada segmento
+ *
+ * steps				Passos de cada eixo no segmento, com sinal
+ * duration				Duração do segmento em s
+ * fullSegment			True se a duração for exatamente SEGMENT_TIME
+ */
+void StepGenerator::queueSegment(const int32_t steps[N_AXIS], float duration, bool fullSegment) {
+	uint32_t events = 0;
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		if ((uint32_t) abs(steps[i]) > events) {
+			events = abs(steps[i]);
+		}
+	}
+
+	//Segmento sem passos só marca o tempo, com um evento em que nenhum eixo anda
+	if (events == 0) {
+		events = 1;
+	}
+
+	prepBlockIndex = (prepBlockIndex + 1) % (SEGMENT_BUFFER_SIZE - 1);
+	StepBlock* next = &blocks[prepBlockIndex];
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		next->steps[i] = (uint32_t) abs(steps[i]) << MAX_SMOOTHING_LEVEL;
+		next->direction[i] = (steps[i] > 0) ? CW : CCW;
+	}
+	next->stepEventCount = events << MAX_SMOOTHING_LEVEL;
+
+	StepPeriod timing = segmentTiming(events, duration, fullSegment);
+
+	StepSegment* segment = &segments[segmentHead];
+	segment->steps = events << timing.level;
+	segment->period = timing.period;
+	segment->block = prepBlockIndex;
+	segment->level = timing.level;
+
+	//Segmento só fica visível para a interrupção depois de completo
+	segmentHead = nextSegment(segmentHead);
+}
+
+/**
+ * Retorna o período e o nível de suavização de um segmento
+ *
+ * steps				Passos do eixo principal no segmento
+ * duration				Duração do segmento em s
+ * fullSegment			True se a duração for exatamente SEGMENT_TIME
+ */
+StepPeriod StepGenerator::segmentTiming(uint32_t steps, float duration, bool fullSegment) {
+	//Segmentos de duração SEGMENT_TIME usam a tabela
+	if (fullSegment && (steps < periodTableSize)) {
+		return periodTable[steps];
+	}
+
+	float period = duration * STEP_TIMER_FREQUENCY / steps;
+	if (period < MINIMUM_STEP_PERIOD) {
+		period = MINIMUM_STEP_PERIOD;
+	} else if (!(period < MAXIMUM_STEP_PERIOD)) {
+		period = MAXIMUM_STEP_PERIOD;
+	}
+
+	//Em taxas baixas cada passo é dividido em vários eventos da interrupção
+	StepPeriod timing;
+	timing.level = smoothingLevel(period);
+	timing.period = (uint32_t) lroundf(period / (1 << timing.level));
+
+	return timing;
+}
+
+/**
+ * Prepara segmentos e inicia a execução caso o timer esteja parado. Deve
+ * ser chamado após adicionar blocos ao planejador e periodicamente
+ * enquanto houver movimento
+ */
+void StepGenerator::wakeUp() {
+	if (error || stopped) {
+		return;
+	}
+
+	prepare();
+	if (segmentHead == segmentTail) {
+		return;
+	}
+
+	//Na saída por DMA a forma de onda já consulta a fila continuamente
+	if (waveform != NULL) {
+		running = true;
+		waveform->start();
+		return;
+	}
+
+	//A interrupção não pode parar o timer entre a checagem e a partida
+	__disable_irq();
+	if (!running && !stopped) {
+		running = true;
+
+		//Primeira interrupção carrega o bloco e configura as direções
+		htim.Instance->CNT = 0;
+		htim.Instance->ARR = STEP_TIMER_FREQUENCY / 100000;
+		htim.Instance->EGR = TIM_EGR_UG;
+		htim.Instance->SR = ~TIM_SR_UIF;
+		htim.Instance->CR1 |= TIM_CR1_CEN;
+	}
+	__enable_irq();
+}
+
+/**
+ * Usa a saída por DMA no lugar da interrupção do timer
+ *
+ * waveform				Gerador de forma de onda que consome os eventos de passo
+ */
+void StepGenerator::setWaveform(StepWaveform* waveform) {
+	this->waveform = waveform;
+}
+
+/**
+ * Define a tabela de períodos usada para os segmentos de duração
+ * SEGMENT_TIME. Segmentos fora da tabela têm o período calculado
+ *
+ * table				Tabela gerada por makeStepPeriodTable
+ * size					Quantidade de entradas da tabela
+ */
+void StepGenerator::setPeriodTable(const StepPeriod* table, uint32_t size) {
+	periodTable = table;
+	periodTableSize = (table != NULL) ? size : 0;
+}
+
+/**
+ * Callback da interrupção do timer
+ */
+void StepGenerator::interruptCallback() {
+	if (!(htim.Instance->SR & TIM_SR_UIF)) {
+		return;
+	}
+	htim.Instance->SR = ~TIM_SR_UIF;
+
+	uint8_t events = stepEvent();
+
+	//Fila vazia, parar o timer
+	if (events & STEP_EVENT_IDLE) {
+		htim.Instance->CR1 &= ~TIM_CR1_CEN;
+		return;
+	}
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		if (events & (1 << i)) {
+			axis[i]->step();
+		}
+	}
+
+	//Evento de mudança de direção nunca tem passos
+	if (events & STEP_EVENT_DIRECTION) {
+		for (uint8_t i = 0; i < N_AXIS; i++) {
+			axis[i]->direction(direction[i]);
+		}
+	}
+
+	htim.Instance->ARR = stepPeriod - 1;
+}
+
+/**
+ * Avança um evento de passo do segmento atual. Retorna os eixos que devem dar
+ * passo (um bit por eixo) e as flags STEP_EVENT_DIRECTION e STEP_EVENT_IDLE.
+ * Quando as direções mudam, o evento não tem passos, garantindo um período
+ * inteiro entre a mudança de direção e o passo anterior e o seguinte
+ */
+uint8_t StepGenerator::stepEvent() {
+	//Interrompido pelos fins de curso, o restante da fila é descartado no reset
+	if (stopped) {
+		running = false;
+		return STEP_EVENT_IDLE;
+	}
+
+	//Todo o cálculo foi feito na preparação, aqui só há somas e comparações
+	if (segment == NULL) {
+		if (segmentHead == segmentTail) {
+			running = false;
+			return STEP_EVENT_IDLE;
+		}
+
+		segment = &segments[segmentTail];
+		segmentSteps = segment->steps;
+		stepPeriod = segment->period;
+
+		//Primeiro segmento de um bloco
+		bool directionChanged = false;
+		if (segment->block != blockIndex) {
+			blockIndex = segment->block;
+			block = &blocks[blockIndex];
+
+			//Eixos parados mantêm a direção anterior
+			for (uint8_t i = 0; i < N_AXIS; i++) {
+				if ((block->steps[i] != 0) && (block->direction[i] != direction[i])) {
+					direction[i] = block->direction[i];
+					directionChanged = true;
+				}
+				increment[i] = (direction[i] == CW) ? 1 : -1;
+				counter[i] = -(int32_t)(block->stepEventCount >> 1);
+			}
+		}
+
+		//Com mais eventos por passo cada evento avança menos os contadores
+		for (uint8_t i = 0; i < N_AXIS; i++) {
+			delta[i] = block->steps[i] >> segment->level;
+		}
+
+		if (directionChanged) {
+			return STEP_EVENT_DIRECTION;
+		}
+	}
+
+	uint8_t events = 0;
+
+	//Bresenham entre os eixos
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		counter[i] += delta[i];
+		if (counter[i] > 0) {
+			counter[i] -= block->stepEventCount;
+			position[i] += increment[i];
+			events |= (1 << i);
+		}
+	}
+
+	//Final do segmento, libera a posição no buffer
+	if (--segmentSteps == 0) {
+		segment = NULL;
+		segmentTail = nextSegment(segmentTail);
+	}
+
+	return events;
+}
+
+/**
+ * Retorna o período até o próximo evento de passo em ticks de STEP_TIMER_FREQUENCY
+ */
+uint32_t StepGenerator::getStepPeriod() {
+	return stepPeriod;
+}
+
+/**
+ * Retorna a direção atual de um eixo (CW ou CCW)
+ *
+ * axis					Índice do eixo
+ */
+uint8_t StepGenerator::getDirection(uint8_t axis) {
+	return direction[axis];
+}
+
+/**
+ * Retorna o motor de um eixo
+ *
+ * axis					Índice do eixo
+ */
+Stepper* StepGenerator::getAxis(uint8_t axis) {
+	return this->axis[axis];
+}
+
+/**
+ * Retorna o índice seguinte ao informado no buffer de segmentos
+ */
+uint8_t StepGenerator::nextSegment(uint8_t index) {
+	return (index + 1) & (SEGMENT_BUFFER_SIZE - 1);
+}
+
+/**
+ * Começa a dividir em segmentos o bloco mais antigo do planejador.
+ * Retorna false se o planejador estiver vazio
+ */
+bool StepGenerator::loadPrepBlock() {
+	prepBlock = planner->currentBlock();
+	if (prepBlock == NULL) {
+		return false;
+	}
+
+	//Bloco não pode mais ser alterado pelo planejador
+	prepBlock->busy = true;
+
+	//Pontos PVT geram um bloco por segmento
+	if (prepBlock->pvt) {
+		pvtTime = 0.0f;
+		for (uint8_t i = 0; i < N_AXIS; i++) {
+			pvtSteps[i] = 0;
+		}
+		return true;
+	}
+
+	//Cópia dos dados de Bresenham, o bloco do planejador é liberado assim que
+	//o último segmento for preparado
+	prepBlockIndex = (prepBlockIndex + 1) % (SEGMENT_BUFFER_SIZE - 1);
+	StepBlock* next = &blocks[prepBlockIndex];
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		next->steps[i] = prepBlock->steps[i] << MAX_SMOOTHING_LEVEL;
+		next->direction[i] = prepBlock->direction[i];
+	}
+	next->stepEventCount = prepBlock->stepEventCount << MAX_SMOOTHING_LEVEL;
+
+	prepSteps = 0;
+	prepTime = 0.0f;
+	prepPosition = 0.0f;
+
+	//Perfil planejado do bloco inteiro
+	profileStart = 0.0f;
+	profileEnd = prepBlock->stepEventCount;
+	setProfile(prepBlock->initialRate, prepBlock->peakRate, prepBlock->finalRate,
+			prepBlock->accelerateUntil, prepBlock->decelerateAfter - prepBlock->accelerateUntil);
+
+	//No feed hold e na retomada o bloco parte da velocidade real, não da planejada
+	float rate = prepSpeed * prepBlock->stepEventCount / prepBlock->distance;
+	if (rate < MINIMUM_STEP_RATE) {
+		rate = MINIMUM_STEP_RATE;
+	}
+
+	if (state == STEP_STATE_HOLD) {
+		replanHold(rate);
+	} else if (replanEntry) {
+		replanEntry = false;
+		replanToExit(rate);
+	}
+
+	return true;
+}
+
+/**
+ * Define o perfil de velocidade a partir das taxas e dos passos de cada fase
+ *
+ * initial				Taxa no início em passos/s
+ * peak					Taxa ao fim da primeira rampa em passos/s
+ * final				Taxa no final em passos/s
+ * acceleration			Passos da primeira rampa
+ * cruise				Passos do cruzeiro
+ */
+void StepGenerator::setProfile(float initial, float peak, float final, float acceleration, float cruise) {
+	initialRate = initial;
+	peakRate = peak;
+	finalRate = final;
+	accelerationSteps = acceleration;
+	cruiseSteps = cruise;
+
+	//Duração de cada fase a partir dos passos e da velocidade média delas
+	float deceleration = profileEnd - profileStart - acceleration - cruise;
+	accelerationTime = 2.0f * acceleration / (initial + peak);
+	cruiseTime = cruise / peak;
+	decelerationTime = 2.0f * deceleration / (peak + final);
+}
+
+/**
+ * Refaz o perfil do bloco em preparação da posição atual até profileEnd.
+ * Retorna a taxa que de fato é alcançada no final, que pode ser diferente
+ * da pedida se não houver distância suficiente
+ *
+ * initial				Taxa atual em passos/s
+ * nominal				Taxa de cruzeiro em passos/s
+ * final				Taxa desejada no final em passos/s
+ */
+float StepGenerator::replan(float initial, float nominal, float final) {
+	profileStart = prepPosition;
+	prepTime = 0.0f;
+
+	float length = profileEnd - profileStart;
+	float accel = prepBlock->accelerationSteps;
+
+	if (final > nominal) {
+		final = nominal;
+	}
+
+	//Mesmo cálculo do planejador, partindo do ponto atual do bloco
+	float first = fabsf(nominal * nominal - initial * initial) / (2.0f * accel);
+	float last = (nominal * nominal - final * final) / (2.0f * accel);
+	float peak = nominal;
+
+	if (first + last > length) {
+		if (initial > nominal) {
+			first = 0.0f;
+		} else {
+			first = (2.0f * accel * length - initial * initial + final * final) / (4.0f * accel);
+			if (first < 0.0f) {
+				first = 0.0f;
+			} else if (first > length) {
+				first = length;
+			}
+		}
+
+		peak = fastSqrt(initial * initial + 2.0f * accel * first);
+		if ((peak > nominal) && (initial <= nominal)) {
+			peak = nominal;
+		}
+
+		//Sem distância para a rampa completa, o final fica onde a rampa chega
+		if (first == 0.0f) {
+			peak = initial;
+			final = fmaxf(final, fastSqrt(fmaxf(initial * initial - 2.0f * accel * length, 0.0f)));
+		} else if (first == length) {
+			final = peak;
+		}
+		last = length - first;
+	}
+
+	if (final < MINIMUM_STEP_RATE) {
+		final = MINIMUM_STEP_RATE;
+	}
+
+	setProfile(initial, peak, final, first, length - first - last);
+
+	return final;
+}
+
+/**
+ * Refaz o perfil do bloco em preparação até o fim dele, terminando na
+ * velocidade de saída planejada. Se ela não puder ser alcançada, o
+ * planejador é avisado da velocidade real
+ *
+ * initial				Taxa atual em passos/s
+ */
+void StepGenerator::replanToExit(float initial) {
+	float rateToSpeed = prepBlock->distance / prepBlock->stepEventCount;
+	float exit = prepBlock->exitSpeed / rateToSpeed;
+	if (exit < MINIMUM_STEP_RATE) {
+		exit = MINIMUM_STEP_RATE;
+	}
+
+	profileEnd = prepBlock->stepEventCount;
+	float final = replan(initial, prepBlock->nominalRate, exit);
+
+	if (fabsf(final - exit) > 1.0f) {
+		planner->setCurrentExitSpeed(final * rateToSpeed);
+	}
+}
+
+/**
+ * Refaz o perfil do bloco em preparação para parar o mais rápido possível
+ * partindo da taxa atual
+ *
+ * initial				Taxa atual em passos/s
+ */
+void StepGenerator::replanHold(float initial) {
+	if (initial < MINIMUM_STEP_RATE) {
+		initial = MINIMUM_STEP_RATE;
+	}
+
+	//Para no passo inteiro seguinte à distância de parada, ou continua
+	//desacelerando no próximo bloco
+	float stop = (initial * initial - (float) MINIMUM_STEP_RATE * MINIMUM_STEP_RATE)
+			/ (2.0f * prepBlock->accelerationSteps);
+	profileEnd = prepBlock->stepEventCount;
+	if (prepPosition + stop < profileEnd) {
+		profileEnd = ceilf(prepPosition + stop);
+	}
+
+	replan(initial, initial, MINIMUM_STEP_RATE);
+}
+
+/**
+ * Retorna quantos passos do bloco em preparação já foram dados em um
+ * instante, de acordo com o perfil de velocidade
+ *
+ * time					Tempo desde o início do perfil em s
+ */
+float StepGenerator::profilePosition(float time) {
+	bool sCurve = prepBlock->sCurve;
+
+	if (time < accelerationTime) {
+		return profileStart + rampPosition(time, accelerationTime, initialRate, peakRate, sCurve);
+	}
+	time -= accelerationTime;
+
+	if (time < cruiseTime) {
+		return profileStart + accelerationSteps + time * peakRate;
+	}
+	time -= cruiseTime;
+
+	if (time < decelerationTime) {
+		return profileStart + accelerationSteps + cruiseSteps
+				+ rampPosition(time, decelerationTime, peakRate, finalRate, sCurve);
+	}
+
+	return profileEnd;
+}
+
+/**
+ * Retorna a taxa de passos do bloco em preparação em um instante
+ *
+ * time					Tempo desde o início do perfil em s
+ */
+float StepGenerator::profileRate(float time) {
+	bool sCurve = prepBlock->sCurve;
+
+	if (time < accelerationTime) {
+		return rampRate(time, accelerationTime, initialRate, peakRate, sCurve);
+	}
+	time -= accelerationTime;
+
+	if (time < cruiseTime) {
+		return peakRate;
+	}
+	time -= cruiseTime;
+
+	if (time < decelerationTime) {
+		return rampRate(time, decelerationTime, peakRate, finalRate, sCurve);
+	}
+
+	return finalRate;
+}
+
+/**
+ * Retorna a distância percorrida em uma rampa
+ *
+ * time					Tempo desde o início da rampa em s
+ * duration				Duração da rampa em s
+ * startRate			Taxa no início da rampa em passos/s
+ * endRate				Taxa no final da rampa em passos/s
+ * sCurve				True se a rampa é em curva S
+ */
+float StepGenerator::rampPosition(float time, float duration, float startRate, float endRate, bool sCurve) {
+	float u = time / duration;
+	float range = endRate - startRate;
+
+	//Integral da taxa: linear na trapezoidal, 3u²-2u³ na curva S
+	if (sCurve) {
+		return startRate * time + range * duration * (u * u * u - 0.5f * u * u * u * u);
+	}
+
+	return startRate * time + 0.5f * range * time * u;
+}
+
+/**
+ * Retorna a taxa em um instante de uma rampa
+ *
+ * time					Tempo desde o início da rampa em s
+ * duration				Duração da rampa em s
+ * startRate			Taxa no início da rampa em passos/s
+ * endRate				Taxa no final da rampa em passos/s
+ * sCurve				True se a rampa é em curva S
+ */
+float StepGenerator::rampRate(float time, float duration, float startRate, float endRate, bool sCurve) {
+	float u = time / duration;
+
+	if (sCurve) {
+		return startRate + (endRate - startRate) * u * u * (3.0f - 2.0f * u);
+	}
+
+	return startRate + (endRate - startRate) * u;
+}
+
+/**
+ * Retorna true se houver algum erro
+ */
+bool StepGenerator::getError() {
+	return error;
+}
+
+//Interruption callbacks
+extern "C" {
+	void TIM2_IRQHandler() {
+		if (timerHandlers[0] != 0) {
+			timerHandlers[0]->interruptCallback();
+		}
+	}
+}
+
+extern "C" {
+	void TIM5_IRQHandler() {
+		if (timerHandlers[1] != 0) {
+			timerHandlers[1]->interruptCallback();
+		}
+	}
+}
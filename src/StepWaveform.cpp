@@ -0,0 +1,308 @@
+/*
+ * StepWaveform.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <StepWaveform.h>
+
+StepWaveform* waveformHandler = 0;
+
+//Callbacks do DMA, chamados a cada metade do buffer escrita nas portas
+static void halfTransferCallback(DMA_HandleTypeDef* hdma) {
+	((StepWaveform*) hdma->Parent)->render(0);
+}
+
+static void transferCallback(DMA_HandleTypeDef* hdma) {
+	((StepWaveform*) hdma->Parent)->render(WAVEFORM_BUFFER_SIZE / 2);
+}
+
+/**
+ * Construtor
+ *
+ * instance				Timer que dispara o DMA (TIM1)
+ * generator			Gerador de passos que fornece os eventos
+ */
+StepWaveform::StepWaveform(TIM_TypeDef* instance, StepGenerator* generator) {
+	error = true;
+	started = false;
+
+	this->generator = generator;
+	timeToEvent = 0;
+	pendingReset = false;
+	idleHalves = 2;
+
+	ports[0] = GPIOA;
+	ports[1] = GPIOB;
+
+	for (uint8_t p = 0; p < WAVEFORM_PORTS; p++) {
+		for (uint32_t i = 0; i < WAVEFORM_BUFFER_SIZE; i++) {
+			buffer[p][i] = 0;
+		}
+	}
+
+	//Todos os pinos precisam estar nas portas atendidas pelo DMA
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		Stepper* axis = generator->getAxis(i);
+
+		stepPort[i] = portIndex(axis->getStepPort());
+		stepPin[i] = axis->getStepPin();
+		dirPort[i] = portIndex(axis->getDirPort());
+		dirPin[i] = axis->getDirPin();
+
+		if ((stepPort[i] >= WAVEFORM_PORTS) || (dirPort[i] >= WAVEFORM_PORTS)) {
+			return;
+		}
+	}
+
+	//Somente o TIM1 tem requisições de DMA no DMA2, o único com acesso às GPIOs
+	if (instance != TIM1) {
+		return;
+	}
+
+	__HAL_RCC_TIM1_CLK_ENABLE();
+	__HAL_RCC_DMA2_CLK_ENABLE();
+
+	uint32_t timerClock = HAL_RCC_GetPCLK2Freq();
+	if ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_CFGR_PPRE2_DIV1) {
+		timerClock *= 2;
+	}
+
+	htim.Instance = instance;
+	htim.Init.Prescaler = 0;
+	htim.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim.Init.Period = (timerClock / WAVEFORM_FREQUENCY) - 1;
+	htim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim.Init.RepetitionCounter = 0;
+	if (HAL_TIM_Base_Init(&htim) != HAL_OK) {
+		return;
+	}
+
+	//GPIOA é escrita no meio do tick, pelo compare do canal 1
+	htim.Instance->CCR1 = htim.Init.Period / 2;
+
+	//DMA2 Stream1 canal 6: TIM1_CH1 -> GPIOA->BSRR
+	//DMA2 Stream5 canal 6: TIM1_UP  -> GPIOB->BSRR
+	DMA_Stream_TypeDef* streams[WAVEFORM_PORTS] = {DMA2_Stream1, DMA2_Stream5};
+
+	for (uint8_t p = 0; p < WAVEFORM_PORTS; p++) {
+		hdma[p].Instance = streams[p];
+		hdma[p].Init.Channel = DMA_CHANNEL_6;
+		hdma[p].Init.Direction = DMA_MEMORY_TO_PERIPH;
+		hdma[p].Init.PeriphInc = DMA_PINC_DISABLE;
+		hdma[p].Init.MemInc = DMA_MINC_ENABLE;
+		hdma[p].Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+		hdma[p].Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+		hdma[p].Init.Mode = DMA_CIRCULAR;
+		hdma[p].Init.Priority = DMA_PRIORITY_VERY_HIGH;
+		hdma[p].Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+		hdma[p].Parent = this;
+
+		if (HAL_DMA_Init(&hdma[p]) != HAL_OK) {
+			return;
+		}
+	}
+
+	//Os dois streams andam juntos, então só o da GPIOB gera interrupções
+	hdma[1].XferHalfCpltCallback = halfTransferCallback;
+	hdma[1].XferCpltCallback = transferCallback;
+
+	waveformHandler = this;
+
+	//Mesma prioridade da interrupção de passos
+	HAL_NVIC_SetPriority(DMA2_Stream5_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(DMA2_Stream5_IRQn);
+
+	error = false;
+}
+
+/**
+ * Destrutor
+ */
+StepWaveform::~StepWaveform() {
+	if (!error) {
+		htim.Instance->CR1 &= ~TIM_CR1_CEN;
+		htim.Instance->DIER &= ~(TIM_DIER_UDE | TIM_DIER_CC1DE);
+
+		for (uint8_t p = 0; p < WAVEFORM_PORTS; p++) {
+			HAL_DMA_Abort(&hdma[p]);
+			HAL_DMA_DeInit(&hdma[p]);
+		}
+
+		HAL_NVIC_DisableIRQ(DMA2_Stream5_IRQn);
+		waveformHandler = 0;
+
+		error = true;
+	}
+}
+
+/**
+ * Inicia o timer e o DMA caso ainda não estejam rodando
+ */
+void StepWaveform::start() {
+	if (error || started) {
+		return;
+	}
+
+	if (HAL_DMA_Start(&hdma[0], (uint32_t) buffer[0], (uint32_t) &ports[0]->BSRR, WAVEFORM_BUFFER_SIZE) != HAL_OK) {
+		return;
+	}
+	if (HAL_DMA_Start_IT(&hdma[1], (uint32_t) buffer[1], (uint32_t) &ports[1]->BSRR, WAVEFORM_BUFFER_SIZE) != HAL_OK) {
+		return;
+	}
+
+	htim.Instance->CNT = 0;
+	htim.Instance->DIER |= TIM_DIER_UDE | TIM_DIER_CC1DE;
+	htim.Instance->CR1 |= TIM_CR1_CEN;
+
+	started = true;
+}
+
+/**
+ * Retorna true enquanto ainda houver passos no buffer a serem escritos
+ */
+bool StepWaveform::playing() {
+	//Depois de duas metades sem eventos, o buffer inteiro já foi escrito
+	return idleHalves < 2;
+}
+
+/**
+ * Descarta os passos já calculados que ainda não foram escritos nas
+ * portas, mantendo os pinos de passo em nível baixo. Pode ser chamado
+ * por interrupções de prioridade maior que a do DMA
+ */
+void StepWaveform::abort() {
+	uint32_t mask[WAVEFORM_PORTS] = {0};
+	for (uint8_t a = 0; a < N_AXIS; a++) {
+		mask[stepPort[a]] |= stepPin[a];
+	}
+
+	//Troca as bordas de subida por bordas de descida, as direções ficam
+	for (uint8_t p = 0; p < WAVEFORM_PORTS; p++) {
+		for (uint32_t i = 0; i < WAVEFORM_BUFFER_SIZE; i++) {
+			buffer[p][i] = (buffer[p][i] & ~mask[p]) | (mask[p] << 16);
+		}
+	}
+	pendingReset = false;
+}
+
+/**
+ * Calcula metade do buffer a partir dos eventos do gerador de passos
+ *
+ * offset				Primeira posição a ser calculada
+ */
+void StepWaveform::render(uint32_t offset) {
+	bool active = false;
+
+	for (uint32_t i = offset; i < offset + (WAVEFORM_BUFFER_SIZE / 2); i++) {
+		uint32_t word[WAVEFORM_PORTS] = {0};
+
+		//Tick seguinte a um evento: abaixa os passos e escreve as direções. A
+		//direção só muda em eventos sem passos, então nunca na borda de um passo
+		if (pendingReset) {
+			for (uint8_t a = 0; a < N_AXIS; a++) {
+				word[stepPort[a]] |= stepPin[a] << 16;
+
+				uint8_t dir = generator->getDirection(a);
+				if (dir == CW || dir == CCW) {
+					if (generator->getAxis(a)->directionLevel(dir)) {
+						word[dirPort[a]] |= dirPin[a];
+					} else {
+						word[dirPort[a]] |= dirPin[a] << 16;
+					}
+				}
+			}
+			pendingReset = false;
+		}
+
+		timeToEvent -= WAVEFORM_TICK;
+		if (timeToEvent <= 0) {
+			uint8_t events = generator->stepEvent();
+
+			if (events & STEP_EVENT_IDLE) {
+				//Consulta a fila de novo no próximo tick
+				timeToEvent = 0;
+			} else {
+				for (uint8_t a = 0; a < N_AXIS; a++) {
+					if (events & (1 << a)) {
+						word[stepPort[a]] |= stepPin[a];
+					}
+				}
+				pendingReset = true;
+				active = true;
+
+				//O resto do período é mantido para não acumular erro. O passo
+				//precisa de um tick alto e um baixo, o que limita a taxa máxima
+				timeToEvent += generator->getStepPeriod();
+				if (timeToEvent <= (int32_t) WAVEFORM_TICK) {
+					timeToEvent = WAVEFORM_TICK + 1;
+				}
+			}
+		}
+
+		buffer[0][i] = word[0];
+		buffer[1][i] = word[1];
+	}
+
+	if (active || pendingReset) {
+		idleHalves = 0;
+	} else if (idleHalves < 2) {
+		idleHalves++;
+	}
+}
+
+/**
+ * Callback da interrupção do DMA
+ */
+void StepWaveform::interruptCallback() {
+	HAL_DMA_IRQHandler(&hdma[1]);
+}
+
+/**
+ * Retorna true se houver algum erro
+ */
+bool StepWaveform::getError() {
+	return error;
+}
+
+/**
+ * Retorna o índice da porta no buffer ou WAVEFORM_PORTS se a porta não for
+ * atendida pelo DMA
+ */
+uint8_t StepWaveform::portIndex(GPIO_TypeDef* port) {
+	for (uint8_t p = 0; p < WAVEFORM_PORTS; p++) {
+		if (ports[p] == port) {
+			return p;
+		}
+	}
+
+	return WAVEFORM_PORTS;
+}
+
+//Interruption callbacks
+extern "C" {
+	void DMA2_Stream5_IRQHandler() {
+		if (waveformHandler != 0) {
+			waveformHandler->interruptCallback();
+		}
+	}
+}
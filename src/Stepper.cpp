@@ -47,6 +47,12 @@ Stepper::Stepper(
 
     //Configura se o motor é invertido ou não
     inverted = invert;
+
+    this->stepPort = stepPort;
+    this->stepPinNumber = stepPinNumber;
+    this->dirPort = dirPort;
+    this->dirPinNumber = dirPinNumber;
+    pulseTimerEnabled = false;
 }
 
 //Recebe o pino de passo, direção e se é para inverter o sentido do motor
@@ -64,6 +70,12 @@ Stepper::Stepper(
 
     //Configura se o motor é invertido ou não
     inverted = invert;
+
+    this->stepPort = stepPort;
+    this->stepPinNumber = stepPinNumber;
+    this->dirPort = dirPort;
+    this->dirPinNumber = dirPinNumber;
+    pulseTimerEnabled = false;
 }
 
 Stepper::~Stepper() {
@@ -75,8 +87,96 @@ Stepper::~Stepper() {
     }
 }
 
+//Passa a gerar o pulso de passo em hardware, com um timer em modo de pulso único
+//ligado ao pino de passo. Retorna false se o timer não puder ser utilizado
+bool Stepper::setPulseTimer(TIM_TypeDef* instance, uint32_t channel, uint32_t alternate, uint32_t pulseWidthNs) {
+	uint32_t timerClock;
+
+	//Habilita o clock do timer e descobre a frequência do barramento
+	if (instance == TIM1) {
+		__HAL_RCC_TIM1_CLK_ENABLE();
+		timerClock = HAL_RCC_GetPCLK2Freq();
+		if ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_CFGR_PPRE2_DIV1) {
+			timerClock *= 2;
+		}
+	} else if (instance == TIM2 || instance == TIM3 || instance == TIM4) {
+		if (instance == TIM2) {
+			__HAL_RCC_TIM2_CLK_ENABLE();
+		} else if (instance == TIM3) {
+			__HAL_RCC_TIM3_CLK_ENABLE();
+		} else {
+			__HAL_RCC_TIM4_CLK_ENABLE();
+		}
+		timerClock = HAL_RCC_GetPCLK1Freq();
+		if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+			timerClock *= 2;
+		}
+	} else {
+		return false;
+	}
+
+	//Largura do pulso em ticks do timer, arredondada para cima
+	uint32_t pulseTicks = (uint32_t) (((uint64_t) pulseWidthNs * timerClock + 999999999ULL) / 1000000000ULL);
+	if (pulseTicks == 0) {
+		pulseTicks = 1;
+	}
+	if (pulseTicks > 0xFFFE) {
+		return false;
+	}
+
+	pulseTimer.Instance = instance;
+	pulseTimer.Init.Prescaler = 0;
+	pulseTimer.Init.CounterMode = TIM_COUNTERMODE_UP;
+	pulseTimer.Init.Period = pulseTicks;
+	pulseTimer.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	pulseTimer.Init.RepetitionCounter = 0;
+	if (HAL_TIM_PWM_Init(&pulseTimer) != HAL_OK) {
+		return false;
+	}
+
+	//PWM modo 2: saída alta de CCR até ARR, ou seja, um pulso de pulseTicks
+	//ticks que começa um tick após a partida do contador
+	TIM_OC_InitTypeDef config;
+	config.OCMode = TIM_OCMODE_PWM2;
+	config.Pulse = 1;
+	config.OCPolarity = TIM_OCPOLARITY_HIGH;
+	config.OCNPolarity = TIM_OCNPOLARITY_HIGH;
+	config.OCFastMode = TIM_OCFAST_DISABLE;
+	config.OCIdleState = TIM_OCIDLESTATE_RESET;
+	config.OCNIdleState = TIM_OCNIDLESTATE_RESET;
+	if (HAL_TIM_PWM_ConfigChannel(&pulseTimer, &config, channel) != HAL_OK) {
+		return false;
+	}
+
+	//Pulso único: o contador para sozinho no fim do período
+	instance->CR1 |= TIM_CR1_OPM;
+	TIM_CCxChannelCmd(instance, channel, TIM_CCx_ENABLE);
+	if (IS_TIM_BREAK_INSTANCE(instance)) {
+		__HAL_TIM_MOE_ENABLE(&pulseTimer);
+	}
+
+	//Pino de passo passa a ser controlado pelo timer
+	GPIO_InitTypeDef GPIO_InitStruct;
+	GPIO_InitStruct.Pin = stepPinNumber;
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+	GPIO_InitStruct.Alternate = alternate;
+	HAL_GPIO_Init(stepPort, &GPIO_InitStruct);
+
+	pulseTimerEnabled = true;
+
+	return true;
+}
+
 //Executa um passo na direção definida
 void Stepper::step() {
+	//Com o timer, a CPU só dispara o pulso
+	if (pulseTimerEnabled) {
+		pulseTimer.Instance->CR1 |= TIM_CR1_CEN;
+		return;
+	}
+
 	stepPin->set();
 	usDelay(1);
     stepPin->reset();
@@ -85,19 +185,16 @@ void Stepper::step() {
 
 //Define a direção de movimento do motor
 void Stepper::direction(uint8_t dir) {
+    dirPin->write(directionLevel(dir));
+}
+
+//Retorna o nível lógico do pino de direção para a direção informada
+bool Stepper::directionLevel(uint8_t dir) {
     if (dir == CW) {
-        if (!inverted) {
-            dirPin->reset();
-        } else {
-        	dirPin->set();
-        }
-    } else {
-        if (!inverted) {
-        	dirPin->set();
-        } else {
-        	dirPin->reset();
-        }
+        return inverted;
     }
+
+    return !inverted;
 }
 
 //Retorna a direção do motor
@@ -145,3 +242,20 @@ bool Stepper::isEnabled() {
 	return false;
 }
 
+
+//Retornam a porta e o pino de passo e de direção, para escrita direta no BSRR
+GPIO_TypeDef* Stepper::getStepPort() {
+	return stepPort;
+}
+
+uint32_t Stepper::getStepPin() {
+	return stepPinNumber;
+}
+
+GPIO_TypeDef* Stepper::getDirPort() {
+	return dirPort;
+}
+
+uint32_t Stepper::getDirPin() {
+	return dirPinNumber;
+}
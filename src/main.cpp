@@ -23,21 +23,20 @@
  *
  */
 
-/**
- * TODO Input
- * TODO EXTI
- * TODO Endstops
- * TODO Homing
- * TODO Considerar movimentação por lista e interrupção
- */
-
 #include "stm32f4xx_hal.h"
 
+#include <cmath>
 #include <string>
 
+#include "Arc.h"
+#include "DigitalIn.h"
 #include "DigitalOut.h"
+#include "PanTilt.h"
 #include "Serial.h"
+#include "Planner.h"
 #include "Stepper.h"
+#include "StepGenerator.h"
+#include "StepWaveform.h"
 #include "clock.h"
 
 //#define PROTOTIPO
@@ -46,28 +45,144 @@
 #define X_MAX 360.0
 #define Y_MAX 360.0
 
-//Passos necessários por grau
+//Eixos rotativos contínuos, um bit por eixo, por exemplo (1 << X_AXIS) para o
+//pan. Não têm limite, a posição é mantida entre 0 e 360 graus e no modo
+//absoluto o movimento segue o menor caminho. Nunca são limites físicos
+#define ROTARY_AXES 0
+
+//Passos necessários por volta de cada eixo
 #ifndef PROTOTIPO
-#define STEPS_DEGREE (20000/360)
+#define X_STEPS_REVOLUTION 20000
+#define Y_STEPS_REVOLUTION 20000
 #else
-#define STEPS_DEGREE (2048.0/360)
+#define X_STEPS_REVOLUTION 2048
+#define Y_STEPS_REVOLUTION 2048
 #endif
 
-//Velocidades máxima e mínima de movimentação em graus/min
-#define MAX_FEEDRATE (54*60)
+//Passos por grau, a conversão exata é feita por degreesToSteps e stepsToDegrees
+#define X_STEPS_DEGREE (X_STEPS_REVOLUTION/360.0f)
+#define Y_STEPS_DEGREE (Y_STEPS_REVOLUTION/360.0f)
+
+//Largura do pulso de passo em ns
+#define STEP_PULSE_WIDTH 1000
+
+//Descomentar para gerar os passos por DMA nos registradores BSRR das GPIOs,
+//sem interrupção por passo. Usa o TIM1 no lugar dos timers de pulso
+//#define STEP_WAVEFORM
+
+//Velocidades máximas de cada eixo em graus/min. Cada movimento é limitado
+//pelo eixo mais lento na sua direção, inclusive com override
+#define X_MAX_FEEDRATE (54*60)
+#define Y_MAX_FEEDRATE (54*60)
+
+//Velocidades máxima e mínima pedidas pelo F em graus/min
+#define MAX_FEEDRATE ((X_MAX_FEEDRATE > Y_MAX_FEEDRATE) ? X_MAX_FEEDRATE : Y_MAX_FEEDRATE)
 #define MIN_FEEDRATE (9*60)
 
-//Posição atual do sistema
+//Aceleração de cada eixo em graus/s²
+#define X_ACCELERATION 180.0
+#define Y_ACCELERATION 180.0
+
+//Tamanho da tabela de períodos: passos de um segmento na maior taxa de passos
+//possível entre os eixos, mais a entrada zero
+#define X_MAX_STEP_RATE (X_MAX_FEEDRATE / 60.0f * X_STEPS_DEGREE)
+#define Y_MAX_STEP_RATE (Y_MAX_FEEDRATE / 60.0f * Y_STEPS_DEGREE)
+#define STEP_PERIOD_TABLE_SIZE ((uint32_t) (((X_MAX_STEP_RATE > Y_MAX_STEP_RATE) \
+		? X_MAX_STEP_RATE : Y_MAX_STEP_RATE) * SEGMENT_TIME) + 2)
+
+//Perfil de velocidade dos movimentos, true para curva S (jerk limitado) e
+//false para trapezoidal. O eixo Y carrega a câmera, que oscila nas paradas
+#ifndef PROTOTIPO
+#define S_CURVE true
+#else
+#define S_CURVE false
+#endif
+
+//Ângulos dos eixos com a visada na direção +X e na horizontal, usados pelo G6
+#define PAN_ZERO 0.0
+#define TILT_ZERO 90.0
+
+//Offsets da montagem da cabeça, na unidade dos pontos do G6: altura do eixo
+//tilt, distância dele à frente do eixo pan e da visada à esquerda do eixo pan
+//e acima do eixo tilt
+#define MOUNT_HEIGHT 0.0
+#define MOUNT_FORWARD 0.0
+#define MOUNT_LATERAL 0.0
+#define MOUNT_SIGHT 0.0
+
+//Desvio de junção em graus, quanto maior mais rápido as curvas são feitas
+#define JUNCTION_DEVIATION 0.05
+
+//Erro máximo entre os segmentos dos arcos (G2/G3) e o arco ideal em graus
+#define ARC_TOLERANCE 0.01
+
+//Fins de curso na posição zero dos eixos, chaves NA ligadas ao GND
+#define X_ENDSTOP PC0
+#define Y_ENDSTOP PC1
+
+//Prioridade da interrupção dos fins de curso, acima da de passos
+#define ENDSTOP_PRIORITY 0
+
+//Eixos em que o fim de curso também é limite físico fora do homing: o
+//acionamento para os passos na própria interrupção e gera um alarme, que só
+//sai com G28 ou M999. 0 para desabilitar
+#define HARD_LIMIT_AXES ((1 << X_AXIS) | (1 << Y_AXIS))
+
+//Homing (G28): busca rápida até o fim de curso, afastamento e aproximação
+//lenta. Velocidades em graus/min e distâncias em graus
+#define HOMING_SEEK_FEEDRATE (18*60)
+#define HOMING_LATCH_FEEDRATE (1*60)
+#define HOMING_PULL_OFF 2.0
+#define HOMING_SEEK_DISTANCE (1.1 * ((X_MAX > Y_MAX) ? X_MAX : Y_MAX))
+
+//Maior intervalo entre pontos PVT (G5) em ms. Um tempo mais distante do ponto
+//anterior não pertence à sequência e é recusado
+#define PVT_MAX_INTERVAL 2000
+
+//Tamanho do buffer circular do DMA de recepção da serial
+#define SERIAL_DMA_SIZE 64
+
+//Tamanho da fila de transmissão da serial, esvaziada por DMA
+#define SERIAL_TX_SIZE 512
+
+//Controle de fluxo da serial, desligado por padrão. SERIAL_FLOW_RTS_CTS precisa
+//de um conversor ligado a PA0 e PA1, o ST-LINK da Nucleo não repassa os pinos.
+//SERIAL_FLOW_XON_XOFF muda o protocolo: o host recebe 0x11 e 0x13 no meio das
+//respostas e os que ele envia pausam a transmissão em vez de chegar ao parser,
+//então só deve ser usado com o controle de fluxo por software ligado no host
+#define SERIAL_FLOW_CONTROL SERIAL_FLOW_NONE
+
+//Comandos em tempo real, tratados assim que chegam pela serial
+#define CMD_FEED_HOLD '!'
+#define CMD_CYCLE_START '~'
+#define CMD_FEED_OVERRIDE_RESET 0x90		//Override em 100%
+#define CMD_FEED_OVERRIDE_PLUS 0x91			//Override +10%
+#define CMD_FEED_OVERRIDE_MINUS 0x92		//Override -10%
+#define CMD_FEED_OVERRIDE_FINE_PLUS 0x93	//Override +1%
+#define CMD_FEED_OVERRIDE_FINE_MINUS 0x94	//Override -1%
+
+//Posição programada pelos comandos em graus. A posição da máquina é mantida
+//em passos pelo planejador e pelo gerador de passos
 float xPos = 0.0;
 float yPos = 0.0;
 
+//Períodos de passo dos segmentos, gerados em tempo de compilação e
+//gravados na flash
+constexpr StepPeriodTable<STEP_PERIOD_TABLE_SIZE> stepPeriodTable =
+		makeStepPeriodTable<STEP_PERIOD_TABLE_SIZE>();
+
+//Passos por volta de cada eixo, usados nas conversões
+const int32_t stepsRevolution[N_AXIS] = {X_STEPS_REVOLUTION, Y_STEPS_REVOLUTION};
+
 //Velocidade de movimentação do sistema
 int feedrate = 18*60;
-uint32_t stepDelay = ((1000000*60/feedrate)/STEPS_DEGREE)-2;
 
 //Se true, modo absoluto de movimentação, se false, modo relativo
 bool absoluteMode = true;
 
+//Tempo do último ponto PVT em ms, 0 depois de uma movimentação por G0-G3
+uint32_t pvtTimestamp = 0;
+
 //Comunicação serial
 Serial* serial;
 
@@ -81,12 +196,35 @@ Stepper yAxis(PB3, PB10, false);
 DigitalOut* enable;
 #endif
 
+//Fins de curso
+DigitalIn* xEndstop;
+DigitalIn* yEndstop;
+
+//Planejador de movimentos e gerador de passos por interrupção
+Planner* planner;
+StepGenerator* stepGenerator;
+#ifdef STEP_WAVEFORM
+StepWaveform* waveform;
+#endif
+
+//Cinemática inversa para apontar para pontos cartesianos
+PanTilt* panTilt;
+
 /**
  * Recebe uma string e analisa ela em busca de comandos
  *
  */
 void parseCommand(std::string command);
 
+/**
+ * Trata os comandos em tempo real, chamado pela interrupção da serial para
+ * cada byte recebido. Retorna true se o byte era um comando
+ *
+ * data				byte recebido
+ *
+ */
+bool realtimeCommand(uint8_t data);
+
 /**
  * Recebe uma string e um char, procura pelo char na string
  * e retorna, caso haja, os números seguidos do char como um
@@ -112,7 +250,7 @@ int parseInt(std::string str, char key, int notFound);
 float parseFloat(std::string str, char key, float notFound);
 
 /**
- * Faz a movimentação em linha de um ponto a outro
+ * Enfileira a movimentação em linha de um ponto a outro no planejador
  *
  * newx				coordenada x do final do movimento
  * newy				coordenada y do final do movimento
@@ -120,6 +258,162 @@ float parseFloat(std::string str, char key, float notFound);
  */
 void line(float newx, float newy);
 
+/**
+ * Enfileira a movimentação em arco no planejador, dividida em segmentos de
+ * linha. O centro é dado por I/J ou, se r for diferente de zero, pelo raio
+ *
+ * newx				coordenada x do final do movimento
+ * newy				coordenada y do final do movimento
+ * i				distância em x do início ao centro
+ * j				distância em y do início ao centro
+ * r				raio, negativo para arcos maiores que meia volta
+ * clockwise		true para sentido horário (G2)
+ *
+ */
+void arc(float newx, float newy, float i, float j, float r, bool clockwise);
+
+/**
+ * Enfileira um ponto PVT no planejador. Os eixos seguem uma cúbica desde o
+ * ponto anterior, chegando à posição com a velocidade pedida no tempo do
+ * ponto. A sequência começa com os eixos parados e termina quando a fila
+ * esvazia. Se o último ponto não tiver velocidade zero os eixos desaceleram
+ * a partir dela e param depois do ponto. Um ponto com os eixos parados
+ * começa uma sequência nova: o tempo continua contando do último ponto, ou
+ * do zero se for menor ou igual a ele
+ *
+ * newx				coordenada x do ponto
+ * newy				coordenada y do ponto
+ * vx				velocidade em x no ponto em graus/s
+ * vy				velocidade em y no ponto em graus/s
+ * timestamp		tempo do ponto em ms, no máximo PVT_MAX_INTERVAL depois
+ *					do anterior
+ *
+ */
+void pvt(float newx, float newy, float vx, float vy, uint32_t timestamp);
+
+/**
+ * Limita um ponto em passos aos limites dos eixos
+ *
+ * point			ponto a ser limitado
+ *
+ */
+void clampSteps(int32_t point[N_AXIS]);
+
+/**
+ * Retorna true se o eixo for rotativo contínuo
+ *
+ * axis				índice do eixo
+ *
+ */
+bool isRotary(uint8_t axis);
+
+/**
+ * Retorna true se o fim de curso de algum eixo com limite físico estiver
+ * acionado. A interrupção só percebe a borda de descida, então uma chave
+ * já fechada (no boot ou depois de M999) precisa ser checada pelo nível
+ *
+ */
+bool limitActive();
+
+/**
+ * Retorna o destino de um eixo rotativo na volta mais próxima da posição
+ * atual, pelo menor caminho. Eixos lineares retornam o próprio destino
+ *
+ * axis				índice do eixo
+ * current			posição atual em graus
+ * target			destino em graus
+ *
+ */
+float shortestPath(uint8_t axis, float current, float target);
+
+/**
+ * Leva um ângulo de um eixo rotativo para 0 a 360 graus. Eixos lineares
+ * retornam o próprio ângulo
+ *
+ * axis				índice do eixo
+ * degrees			ângulo a ser normalizado
+ *
+ */
+float normalizeDegrees(uint8_t axis, float degrees);
+
+/**
+ * Retorna os passos a somar a degreesToSteps para chegar à posição do
+ * planejador. Em eixos rotativos a posição em passos pode estar em qualquer
+ * volta, enquanto a posição programada fica entre 0 e 360 graus
+ *
+ * axis				índice do eixo
+ * current			posição programada atual em graus
+ *
+ */
+int32_t turnBase(uint8_t axis, float current);
+
+/**
+ * Leva a posição em passos dos eixos rotativos para a primeira volta,
+ * somando voltas inteiras, sem perder passos. Só deve ser chamado com os
+ * motores parados e a fila vazia
+ *
+ */
+void normalizeSteps();
+
+/**
+ * Para a rotação contínua com desaceleração e espera os eixos pararem.
+ * A posição programada passa a ser aquela em que eles pararam
+ *
+ */
+void stopVelocity();
+
+/**
+ * Faz o homing de um eixo: busca rápida até o fim de curso, afastamento,
+ * aproximação lenta e afastamento final. O ponto do afastamento final,
+ * HOMING_PULL_OFF depois do acionamento na aproximação lenta, se torna o
+ * zero do eixo. Retorna false se o fim de curso não for encontrado ou não
+ * soltar
+ *
+ * axis				índice do eixo
+ * endstop			fim de curso do eixo
+ *
+ */
+bool home(uint8_t axis, DigitalIn* endstop);
+
+/**
+ * Move um eixo durante o homing e espera o fim do movimento. Na busca o
+ * movimento é interrompido pelo fim de curso e retorna true se ele foi
+ * acionado, no afastamento retorna true se ele soltou
+ *
+ * axis				índice do eixo
+ * endstop			fim de curso do eixo
+ * distance			distância em graus, negativa em direção ao fim de curso
+ * feedrate			velocidade em graus/min
+ * seek				true para buscar o fim de curso
+ *
+ */
+bool homingMove(uint8_t axis, DigitalIn* endstop, float distance, float feedrate, bool seek);
+
+/**
+ * Interrupções dos fins de curso, repassadas ao gerador de passos
+ *
+ */
+void xEndstopInterrupt();
+void yEndstopInterrupt();
+
+/**
+ * Converte graus para a posição mais próxima em passos de um eixo
+ *
+ * axis				índice do eixo
+ * degrees			ângulo a ser convertido
+ *
+ */
+int32_t degreesToSteps(uint8_t axis, float degrees);
+
+/**
+ * Converte passos de um eixo para graus
+ *
+ * axis				índice do eixo
+ * steps			quantidade de passos a ser convertida
+ *
+ */
+float stepsToDegrees(uint8_t axis, int32_t steps);
+
 int main(void) {
 
 	//Configurações iniciais
@@ -141,35 +435,117 @@ int main(void) {
 #endif
 
 	//Inicialização da Serial
-	serial = new Serial(USART2, 115200, 128);
+	serial = new Serial(USART2, 115200);
 	if (serial->getError()) {
 		while(1);
 	}
 
+	//Recepção por DMA, sem depender da latência da interrupção de passos. Se
+	//não for possível a recepção continua por interrupção a cada byte
+	serial->enableDmaReception(SERIAL_DMA_SIZE);
+
+	//Transmissão por DMA, o eco e as respostas não prendem mais o loop
+	//principal. Se não for possível a transmissão continua bloqueante
+	serial->enableDmaTransmission(SERIAL_TX_SIZE);
+
+	//O host é mandado parar quando o buffer de recepção enche, em vez de
+	//bytes serem perdidos
+#if SERIAL_FLOW_CONTROL != SERIAL_FLOW_NONE
+	serial->enableFlowControl(SERIAL_FLOW_CONTROL);
+#endif
+
+	//Pulsos de passo gerados pelos timers ligados aos pinos de passo
+#ifndef STEP_WAVEFORM
+#ifndef PROTOTIPO
+	if (!xAxis.setPulseTimer(TIM1, TIM_CHANNEL_1, GPIO_AF1_TIM1, STEP_PULSE_WIDTH)
+			|| !yAxis.setPulseTimer(TIM3, TIM_CHANNEL_2, GPIO_AF2_TIM3, STEP_PULSE_WIDTH)) {
+		while(1);
+	}
+#else
+	if (!xAxis.setPulseTimer(TIM1, TIM_CHANNEL_3, GPIO_AF1_TIM1, STEP_PULSE_WIDTH)
+			|| !yAxis.setPulseTimer(TIM2, TIM_CHANNEL_2, GPIO_AF1_TIM2, STEP_PULSE_WIDTH)) {
+		while(1);
+	}
+#endif
+#endif
+
+	//Inicialização do planejador e do gerador de passos
+	{
+		const float stepsPerDegree[N_AXIS] = {X_STEPS_DEGREE, Y_STEPS_DEGREE};
+		const float maxFeedrate[N_AXIS] = {X_MAX_FEEDRATE, Y_MAX_FEEDRATE};
+		const float acceleration[N_AXIS] = {X_ACCELERATION, Y_ACCELERATION};
+		planner = new Planner(stepsPerDegree, maxFeedrate, acceleration, JUNCTION_DEVIATION, S_CURVE);
+	}
+	stepGenerator = new StepGenerator(TIM5, planner, &xAxis, &yAxis);
+	if (stepGenerator->getError()) {
+		while(1);
+	}
+	stepGenerator->setPeriodTable(stepPeriodTable.entries, STEP_PERIOD_TABLE_SIZE);
+
+#ifdef STEP_WAVEFORM
+	waveform = new StepWaveform(TIM1, stepGenerator);
+	if (waveform->getError()) {
+		while(1);
+	}
+	stepGenerator->setWaveform(waveform);
+#endif
+
+	panTilt = new PanTilt(PAN_ZERO, TILT_ZERO);
+	panTilt->setOffsets(MOUNT_HEIGHT, MOUNT_FORWARD, MOUNT_LATERAL, MOUNT_SIGHT);
+
+	//Feed hold, retomada e override chegam pela interrupção da serial
+	serial->setRealtimeHandler(realtimeCommand);
+
+	//Fins de curso param o gerador de passos direto da interrupção
+	xEndstop = new DigitalIn(X_ENDSTOP, GPIO_PULLUP);
+	yEndstop = new DigitalIn(Y_ENDSTOP, GPIO_PULLUP);
+	if (xEndstop->getError() || yEndstop->getError()
+			|| !xEndstop->enableInterrupt(GPIO_MODE_IT_FALLING, xEndstopInterrupt, ENDSTOP_PRIORITY)
+			|| !yEndstop->enableInterrupt(GPIO_MODE_IT_FALLING, yEndstopInterrupt, ENDSTOP_PRIORITY)) {
+		while(1);
+	}
+	stepGenerator->setHardLimits(HARD_LIMIT_AXES & ~ROTARY_AXES);
+	bool alarmReported = false;
+	uint32_t txOverflowsReported = 0;
+
 	//String para armazenar o comando recebido pela serial
 	std::string command;
 
 	while (1) {
-		//Checa por dados na serial
-		if (serial->available()) {
-			uint8_t value;
+		//Mantém o buffer de segmentos cheio enquanto houver movimento
+		stepGenerator->wakeUp();
+
+		//Eixos rotativos voltam para a primeira volta com os motores parados
+		if (!stepGenerator->busy() && planner->empty()) {
+			normalizeSteps();
+		}
 
-			//Recebe um caractere
-			serial->getChar(&value);
+		//Limite físico atingido, os passos já foram parados pela interrupção
+		if (stepGenerator->inAlarm() != alarmReported) {
+			alarmReported = stepGenerator->inAlarm();
+			if (alarmReported) {
+				serial->println("ALARME: limite fisico atingido, use G28 ou M999");
+			}
+		}
+
+		//Mensagens descartadas com a fila de transmissão cheia, avisa quando
+		//houver espaço de novo
+		if ( (serial->getTxOverflows() != txOverflowsReported) && (serial->txFree() >= 64) ) {
+			txOverflowsReported = serial->getTxOverflows();
+			serial->println("AVISO: %lu mensagens descartadas", (unsigned long) txOverflowsReported);
+		}
+
+		//Checa por dados na serial, lidos direto do buffer de recepção até o
+		//fim de uma linha
+		SerialRxBuffer::Span received = serial->readSpan();
+		size_t used = 0;
+		bool endOfLine = false;
+		while ( (used < received.length) && !endOfLine ) {
+			uint8_t value = received.data[used++];
 
 			//Verifica se é algum caractere de final de comando
 			if (value == '\n' || value == '\r') {
-				//Se houver dados na string analisa o comando (checa por sequências \n\r e \r\n)
-				if (!command.empty()) {
-					//Imprime o comando
-					serial->println(command);
-
-					//Analisa e executa o comando
-					parseCommand(command);
-					command.clear();
-				}
-
-				led.toggle();
+				endOfLine = true;
 			} else {
 				//Se não for caractere de final de comando
 				//Limita o tamanho da string em 64 bytes
@@ -182,6 +558,23 @@ int main(void) {
 			}
 		}
 
+		//Libera os bytes antes de executar o comando, que pode demorar
+		serial->consume(used);
+
+		if (endOfLine) {
+			//Se houver dados na string analisa o comando (checa por sequências \n\r e \r\n)
+			if (!command.empty()) {
+				//Imprime o comando
+				serial->println(command);
+
+				//Analisa e executa o comando
+				parseCommand(command);
+				command.clear();
+			}
+
+			led.toggle();
+		}
+
 		//led.toggle();
 		//usDelay(10);
 	}
@@ -197,10 +590,25 @@ void parseCommand(std::string command) {
 	//Checar se é um comando G
 	cmd = parseInt(command, 'G', -1);
 	if (cmd != -1) {
+		//No modo de velocidade a fila só anda depois de M5
+		if (stepGenerator->velocityActive()) {
+			serial->println("Eixos girando, use M5");
+			return;
+		}
+
 		switch(cmd) {
 		case 0:
 		case 1:
-			//Mover em linha
+		case 2:
+		case 3:
+		case 6:
+			//Mover em linha (G0/G1), em arco (G2 horário, G3 anti-horário) ou
+			//apontar para um ponto cartesiano (G6)
+			if (stepGenerator->inAlarm() || limitActive()) {
+				serial->println("Em alarme");
+				break;
+			}
+
 			//Obter o valor da velocidade, manter o mesmo caso não haja
 			feedrate = parseInt(command, 'F', feedrate);
 
@@ -210,21 +618,97 @@ void parseCommand(std::string command) {
 				feedrate = MIN_FEEDRATE;
 			}
 
-			stepDelay = ((1000000*60/feedrate)/STEPS_DEGREE)-2;
-
 			//Obter os valores de X e Y e fazer a movimentação
-			if (absoluteMode) {
-				line(parseFloat(command, 'X', xPos), parseFloat(command, 'Y', yPos));
-			} else {
-				line(xPos+parseFloat(command, 'X', 0), yPos+parseFloat(command, 'Y', 0));
+			{
+				float newx, newy;
+				if (cmd == 6) {
+					//Ponto sempre absoluto, os ângulos vêm da cinemática inversa
+					float angles[N_AXIS];
+					if (!panTilt->pointAt(parseFloat(command, 'X', 0), parseFloat(command, 'Y', 0),
+							parseFloat(command, 'Z', 0), angles)) {
+						serial->println("Alvo inalcancavel");
+						break;
+					}
+					newx = shortestPath(X_AXIS, xPos, angles[X_AXIS]);
+					newy = shortestPath(Y_AXIS, yPos, angles[Y_AXIS]);
+				} else if (absoluteMode) {
+					//Eixos rotativos vão pelo menor caminho até o ângulo pedido
+					newx = shortestPath(X_AXIS, xPos, parseFloat(command, 'X', xPos));
+					newy = shortestPath(Y_AXIS, yPos, parseFloat(command, 'Y', yPos));
+				} else {
+					newx = xPos+parseFloat(command, 'X', 0);
+					newy = yPos+parseFloat(command, 'Y', 0);
+				}
+
+				//Próximo ponto PVT começa uma sequência nova
+				pvtTimestamp = 0;
+
+				if ((cmd < 2) || (cmd == 6)) {
+					line(newx, newy);
+				} else {
+					//I e J são sempre relativos ao início do arco
+					arc(newx, newy, parseFloat(command, 'I', 0), parseFloat(command, 'J', 0),
+							parseFloat(command, 'R', 0), cmd == 2);
+				}
+			}
+			break;
+
+		case 5:
+			//Ponto PVT para rastreamento: posição X/Y, velocidade I/J em graus/s
+			//e tempo T em ms desde o início da sequência
+			if (stepGenerator->inAlarm() || limitActive()) {
+				serial->println("Em alarme");
+				break;
+			}
+
+			{
+				float newx, newy;
+				if (absoluteMode) {
+					newx = shortestPath(X_AXIS, xPos, parseFloat(command, 'X', xPos));
+					newy = shortestPath(Y_AXIS, yPos, parseFloat(command, 'Y', yPos));
+				} else {
+					newx = xPos+parseFloat(command, 'X', 0);
+					newy = yPos+parseFloat(command, 'Y', 0);
+				}
+
+				pvt(newx, newy, parseFloat(command, 'I', 0), parseFloat(command, 'J', 0),
+						parseInt(command, 'T', 0));
 			}
 			break;
 
 		case 4:
-			//Esperar
+			//Esperar o fim dos movimentos e então aguardar o tempo pedido
+			stepGenerator->synchronize();
 			HAL_Delay(parseInt(command, 'P', 0)*1000);
 			break;
 
+		case 28:
+			//Homing dos eixos pedidos, ou de todos se nenhum for informado. Os
+			//limites físicos ficam desligados, as chaves são acionadas de propósito
+			stepGenerator->synchronize();
+			stepGenerator->clearAlarm();
+			stepGenerator->setHardLimits(0);
+			{
+				bool homeX = command.find('X') != std::string::npos;
+				bool homeY = command.find('Y') != std::string::npos;
+				if (!homeX && !homeY) {
+					homeX = true;
+					homeY = true;
+				}
+
+				if ((homeX && !home(X_AXIS, xEndstop)) || (homeY && !home(Y_AXIS, yEndstop))) {
+					serial->println("Falha no homing");
+				}
+
+				//Posição programada segue a posição real
+				int32_t position[N_AXIS];
+				stepGenerator->getPosition(position);
+				xPos = normalizeDegrees(X_AXIS, stepsToDegrees(X_AXIS, position[X_AXIS]));
+				yPos = normalizeDegrees(Y_AXIS, stepsToDegrees(Y_AXIS, position[Y_AXIS]));
+			}
+			stepGenerator->setHardLimits(HARD_LIMIT_AXES & ~ROTARY_AXES);
+			break;
+
 		case 90:
 			//Mudar para modo absoluto
 			absoluteMode = true;
@@ -237,8 +721,14 @@ void parseCommand(std::string command) {
 
 		case 92:
 			//Setar a posição atual
-			xPos = parseFloat(command, 'X', xPos);
-			yPos = parseFloat(command, 'Y', yPos);
+			stepGenerator->synchronize();
+			xPos = normalizeDegrees(X_AXIS, parseFloat(command, 'X', xPos));
+			yPos = normalizeDegrees(Y_AXIS, parseFloat(command, 'Y', yPos));
+			{
+				int32_t position[N_AXIS] = {degreesToSteps(X_AXIS, xPos), degreesToSteps(Y_AXIS, yPos)};
+				planner->setPosition(position);
+				stepGenerator->setPosition(position);
+			}
 			break;
 
 		default:
@@ -250,6 +740,28 @@ void parseCommand(std::string command) {
 	cmd = parseInt(command, 'M', -1);
 	if (cmd != -1) {
 		switch(cmd) {
+		case 3:
+			//Girar continuamente os eixos pedidos em graus/s, negativo para o
+			//sentido contrário. Começa quando os movimentos na fila terminam
+			if (stepGenerator->inAlarm() || limitActive()) {
+				serial->println("Em alarme");
+				break;
+			}
+
+			if (command.find('X') != std::string::npos) {
+				stepGenerator->setVelocity(X_AXIS, parseFloat(command, 'X', 0));
+			}
+			if (command.find('Y') != std::string::npos) {
+				stepGenerator->setVelocity(Y_AXIS, parseFloat(command, 'Y', 0));
+			}
+			stepGenerator->wakeUp();
+			break;
+
+		case 5:
+			//Parar a rotação contínua com desaceleração
+			stopVelocity();
+			break;
+
 		case 17:
 			//Habilitar motores
 #ifndef PROTOTIPO
@@ -262,6 +774,8 @@ void parseCommand(std::string command) {
 
 		case 18:
 			//Desabilitar motores
+			stopVelocity();
+			stepGenerator->synchronize();
 #ifndef PROTOTIPO
 			xAxis.disable();
 			yAxis.disable();
@@ -277,7 +791,82 @@ void parseCommand(std::string command) {
 
 		case 114:
 			//Dizer a posição atual e velocidade
-			serial->println("X:%.3f, Y:%.3f, F:%d", xPos, yPos, feedrate);
+			{
+				int32_t position[N_AXIS];
+				stepGenerator->getPosition(position);
+				serial->println("X:%.3f, Y:%.3f, F:%d", normalizeDegrees(X_AXIS, stepsToDegrees(X_AXIS, position[X_AXIS])),
+						normalizeDegrees(Y_AXIS, stepsToDegrees(Y_AXIS, position[Y_AXIS])), feedrate);
+			}
+			break;
+
+		case 201:
+		case 203:
+			//Definir a aceleração em graus/s² (M201) ou a velocidade máxima em
+			//graus/min (M203) dos eixos informados. Os demais não mudam
+			{
+				const char letters[N_AXIS] = {'X', 'Y'};
+				bool found = false;
+				for (uint8_t i = 0; i < N_AXIS; i++) {
+					if (command.find(letters[i]) == std::string::npos) {
+						continue;
+					}
+					found = true;
+
+					float value = parseFloat(command, letters[i], 0);
+					if (!(value > 0.0f)) {
+						serial->println("Valor invalido para %c", letters[i]);
+					} else if (cmd == 201) {
+						planner->setAcceleration(i, value);
+					} else {
+						planner->setMaxFeedrate(i, value);
+					}
+				}
+
+				if (!found) {
+					serial->println("Nenhum eixo informado");
+				}
+			}
+			break;
+
+		case 204:
+			//Definir a aceleração de todos os eixos em graus/s²
+			{
+				float value = parseFloat(command, 'S', 0);
+				if (!(value > 0.0f)) {
+					serial->println("Valor invalido para S");
+				} else {
+					planner->setAcceleration(value);
+				}
+			}
+			break;
+
+		case 206:
+			//Definir os offsets da montagem usados pelo G6: altura H do eixo tilt,
+			//distância D dele à frente do eixo pan, L da visada à esquerda do eixo
+			//pan e V da visada acima do eixo tilt
+			panTilt->setOffsets(parseFloat(command, 'H', MOUNT_HEIGHT), parseFloat(command, 'D', MOUNT_FORWARD),
+					parseFloat(command, 'L', MOUNT_LATERAL), parseFloat(command, 'V', MOUNT_SIGHT));
+			break;
+
+		case 220:
+			//Definir o override de velocidade em %
+			stepGenerator->setFeedOverride(parseInt(command, 'S', 100));
+			break;
+
+		case 999:
+			//Sair do alarme sem homing, mantendo a posição contada em passos. Com
+			//a chave ainda acionada o eixo continuaria entrando no limite
+			if (limitActive()) {
+				serial->println("Em alarme");
+				break;
+			}
+			stepGenerator->clearAlarm();
+			{
+				int32_t position[N_AXIS];
+				stepGenerator->getPosition(position);
+				xPos = normalizeDegrees(X_AXIS, stepsToDegrees(X_AXIS, position[X_AXIS]));
+				yPos = normalizeDegrees(Y_AXIS, stepsToDegrees(Y_AXIS, position[Y_AXIS]));
+			}
 			break;
 
 		default:
@@ -286,6 +875,50 @@ void parseCommand(std::string command) {
 	}
 }
 
+/**
+ * Trata os comandos em tempo real, chamado pela interrupção da serial para
+ * cada byte recebido. Retorna true se o byte era um comando
+ *
+ * data				byte recebido
+ *
+ */
+bool realtimeCommand(uint8_t data) {
+	switch (data) {
+	case CMD_FEED_HOLD:
+		stepGenerator->feedHold();
+		break;
+
+	case CMD_CYCLE_START:
+		stepGenerator->cycleStart();
+		break;
+
+	case CMD_FEED_OVERRIDE_RESET:
+		stepGenerator->setFeedOverride(100);
+		break;
+
+	case CMD_FEED_OVERRIDE_PLUS:
+		stepGenerator->setFeedOverride(stepGenerator->getFeedOverride() + 10);
+		break;
+
+	case CMD_FEED_OVERRIDE_MINUS:
+		stepGenerator->setFeedOverride(stepGenerator->getFeedOverride() - 10);
+		break;
+
+	case CMD_FEED_OVERRIDE_FINE_PLUS:
+		stepGenerator->setFeedOverride(stepGenerator->getFeedOverride() + 1);
+		break;
+
+	case CMD_FEED_OVERRIDE_FINE_MINUS:
+		stepGenerator->setFeedOverride(stepGenerator->getFeedOverride() - 1);
+		break;
+
+	default:
+		return false;
+	}
+
+	return true;
+}
+
 /**
  * Recebe uma string e um char, procura pelo char na string
  * e retorna, caso haja, os números seguidos do char como um
@@ -355,80 +988,468 @@ float parseFloat(std::string str, char key, float notFound) {
 }
 
 /**
- * Faz a movimentação em linha de um ponto a outro
+ * Enfileira a movimentação em linha de um ponto a outro no planejador
  *
  * newx				coordenada x do final do movimento
  * newy				coordenada y do final do movimento
  *
  */
 void line(float newx,float newy) {
-    int32_t over = 0;
-
     //Garantir limites do eixo X
-    if (newx >= X_MAX) {
-        newx = X_MAX;
-    } else if (newx <= 0) {
-    	newx = 0;
+    if (!isRotary(X_AXIS)) {
+        if (newx >= X_MAX) {
+            newx = X_MAX;
+        } else if (newx <= 0) {
+        	newx = 0;
+        }
     }
 
     //Garantir limites do eixo Y
-    if (newy >= Y_MAX) {
-        newy = Y_MAX;
-    } else if (newy <= 0) {
-    	newy = 0;
+    if (!isRotary(Y_AXIS)) {
+        if (newy >= Y_MAX) {
+            newy = Y_MAX;
+        } else if (newy <= 0) {
+        	newy = 0;
+        }
     }
 
-    //Calcular quanto mover cada eixo
-    int32_t dx  = (newx-xPos)*STEPS_DEGREE;
-    int32_t dy  = (newy-yPos)*STEPS_DEGREE;
+    //Converter o destino para passos, a partir daqui tudo é inteiro
+    int32_t target[N_AXIS] = {turnBase(X_AXIS, xPos) + degreesToSteps(X_AXIS, newx),
+    		turnBase(Y_AXIS, yPos) + degreesToSteps(Y_AXIS, newy)};
 
-    //Checar a direção de movimento
-    if (dx > 0) {
-        xAxis.direction(CW);
-    } else {
-        xAxis.direction(CCW);
+    //Aguardar espaço na fila, preparando segmentos, e enviar o movimento para o planejador.
+    //Uma parada pelos limites descarta o movimento
+    while (planner->full() && !stepGenerator->isStopped()) {
+    	stepGenerator->wakeUp();
     }
-
-    if (dy > 0) {
-        yAxis.direction(CW);
-    } else {
-        yAxis.direction(CCW);
+    if (stepGenerator->isStopped()) {
+    	return;
     }
+    planner->bufferLine(target, feedrate);
+    stepGenerator->wakeUp();
+
+    //Atualizar as posições
+    xPos = normalizeDegrees(X_AXIS, newx);
+    yPos = normalizeDegrees(Y_AXIS, newy);
+}
+
+/**
+ * Enfileira um ponto PVT no planejador. Os eixos seguem uma cúbica desde o
+ * ponto anterior, chegando à posição com a velocidade pedida no tempo do
+ * ponto. A sequência começa com os eixos parados e termina quando a fila
+ * esvazia. Se o último ponto não tiver velocidade zero os eixos desaceleram
+ * a partir dela e param depois do ponto. Um ponto com os eixos parados
+ * começa uma sequência nova: o tempo continua contando do último ponto, ou
+ * do zero se for menor ou igual a ele
+ *
+ * newx				coordenada x do ponto
+ * newy				coordenada y do ponto
+ * vx				velocidade em x no ponto em graus/s
+ * vy				velocidade em y no ponto em graus/s
+ * timestamp		tempo do ponto em ms, no máximo PVT_MAX_INTERVAL depois
+ *					do anterior
+ *
+ */
+void pvt(float newx, float newy, float vx, float vy, uint32_t timestamp) {
+	//Com os eixos parados o ponto começa uma sequência nova, a partir do
+	//repouso e da posição em que eles pararam. Um host que mantém o próprio
+	//relógio continua do último ponto, um que reinicia o relógio começa do zero
+	if (!stepGenerator->busy()) {
+		planner->resetPvt();
+		if (timestamp <= pvtTimestamp) {
+			pvtTimestamp = 0;
+		}
 
-    dx = abs(dx);
-    dy = abs(dy);
+		int32_t position[N_AXIS];
+		stepGenerator->getPosition(position);
+		xPos = normalizeDegrees(X_AXIS, stepsToDegrees(X_AXIS, position[X_AXIS]));
+		yPos = normalizeDegrees(Y_AXIS, stepsToDegrees(Y_AXIS, position[Y_AXIS]));
+	}
 
-    //Movimentar
-    if (dx > dy) {
-        over = dx/2;
-        for (int32_t i = 0; i < dx; ++i) {
-            xAxis.step();
-            over += dy;
+	if ((timestamp <= pvtTimestamp) || (timestamp - pvtTimestamp > PVT_MAX_INTERVAL)) {
+		serial->println("Tempo invalido");
+		return;
+	}
+	float duration = (timestamp - pvtTimestamp) / 1000.0f;
 
-            if (over >= dx) {
-                over -= dx;
-                yAxis.step();
-            }
+	//Garantir limites dos eixos
+	if (!isRotary(X_AXIS)) {
+		newx = (newx >= X_MAX) ? X_MAX : ((newx <= 0) ? 0 : newx);
+	}
+	if (!isRotary(Y_AXIS)) {
+		newy = (newy >= Y_MAX) ? Y_MAX : ((newy <= 0) ? 0 : newy);
+	}
 
-            usDelay(stepDelay);
-        }
-    } else {
-        over = dy/2;
-        for (int32_t i = 0; i < dy; ++i) {
-            yAxis.step();
-            over += dx;
-
-            if (over >= dy) {
-                over -= dy;
-                xAxis.step();
-            }
-
-            usDelay(stepDelay);
-        }
-    }
+	int32_t target[N_AXIS] = {turnBase(X_AXIS, xPos) + degreesToSteps(X_AXIS, newx),
+			turnBase(Y_AXIS, yPos) + degreesToSteps(Y_AXIS, newy)};
+	float velocity[N_AXIS] = {vx, vy};
+
+	//Trecho mais rápido que o eixo permite é descartado, as velocidades dos
+	//pontos são limitadas
+	int32_t position[N_AXIS];
+	planner->getPosition(position);
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		float maxSpeed = planner->getMaxSpeed(i);
+		if (fabsf(stepsToDegrees(i, target[i] - position[i])) > maxSpeed * duration) {
+			serial->println("Velocidade acima do limite");
+			return;
+		}
+		velocity[i] = fmaxf(-maxSpeed, fminf(velocity[i], maxSpeed));
+	}
 
-    //Atualizar as posições
-    xPos = newx;
-    yPos = newy;
+	//Aguardar espaço na fila, preparando segmentos. Uma parada pelos limites
+	//descarta o ponto
+	while (planner->full() && !stepGenerator->isStopped()) {
+		stepGenerator->wakeUp();
+	}
+	if (stepGenerator->isStopped()) {
+		return;
+	}
+	planner->bufferPvt(target, velocity, duration);
+	stepGenerator->wakeUp();
+
+	//Atualizar as posições e o tempo da sequência
+	pvtTimestamp = timestamp;
+	xPos = normalizeDegrees(X_AXIS, newx);
+	yPos = normalizeDegrees(Y_AXIS, newy);
+}
+
+/**
+ * Enfileira a movimentação em arco no planejador, dividida em segmentos de
+ * linha. O centro é dado por I/J ou, se r for diferente de zero, pelo raio
+ *
+ * newx				coordenada x do final do movimento
+ * newy				coordenada y do final do movimento
+ * i				distância em x do início ao centro
+ * j				distância em y do início ao centro
+ * r				raio, negativo para arcos maiores que meia volta
+ * clockwise		true para sentido horário (G2)
+ *
+ */
+void arc(float newx, float newy, float i, float j, float r, bool clockwise) {
+	//O arco é calculado a partir da posição já enviada ao planejador, em uma
+	//escala comum aos dois eixos (a do eixo de maior resolução) para continuar
+	//circular quando os passos por grau são diferentes
+	const float scale = fmaxf(X_STEPS_DEGREE, Y_STEPS_DEGREE);
+	int32_t origin[N_AXIS] = {(int32_t) lroundf(xPos * scale), (int32_t) lroundf(yPos * scale)};
+	int32_t end[N_AXIS] = {(int32_t) lroundf(newx * scale), (int32_t) lroundf(newy * scale)};
+	int32_t base[N_AXIS] = {turnBase(X_AXIS, xPos), turnBase(Y_AXIS, yPos)};
+	int32_t target[N_AXIS] = {base[X_AXIS] + degreesToSteps(X_AXIS, newx),
+			base[Y_AXIS] + degreesToSteps(Y_AXIS, newy)};
+	float tolerance = ARC_TOLERANCE * scale;
+
+	Arc path = (r != 0) ? Arc(origin, end, r * scale, clockwise, tolerance)
+			: Arc(origin, end, i * scale, j * scale, clockwise, tolerance);
+
+	if (path.getError()) {
+		serial->println("Arco invalido");
+		return;
+	}
+
+	//Cada segmento é convertido para os passos de cada eixo e entra na fila
+	//assim que houver espaço. O último usa o destino exato
+	int32_t arcPoint[N_AXIS];
+	int32_t point[N_AXIS];
+	while (path.next(arcPoint)) {
+		if ((arcPoint[X_AXIS] == end[X_AXIS]) && (arcPoint[Y_AXIS] == end[Y_AXIS])) {
+			point[X_AXIS] = target[X_AXIS];
+			point[Y_AXIS] = target[Y_AXIS];
+		} else {
+			point[X_AXIS] = base[X_AXIS] + degreesToSteps(X_AXIS, arcPoint[X_AXIS] / scale);
+			point[Y_AXIS] = base[Y_AXIS] + degreesToSteps(Y_AXIS, arcPoint[Y_AXIS] / scale);
+		}
+		clampSteps(point);
+
+		while (planner->full() && !stepGenerator->isStopped()) {
+			stepGenerator->wakeUp();
+		}
+		if (stepGenerator->isStopped()) {
+			return;
+		}
+		planner->bufferLine(point, feedrate);
+		stepGenerator->wakeUp();
+	}
+
+	//Atualizar as posições, mantendo o valor programado se o final não foi limitado
+	xPos = (point[X_AXIS] == target[X_AXIS]) ? newx : stepsToDegrees(X_AXIS, point[X_AXIS]);
+	yPos = (point[Y_AXIS] == target[Y_AXIS]) ? newy : stepsToDegrees(Y_AXIS, point[Y_AXIS]);
+	xPos = normalizeDegrees(X_AXIS, xPos);
+	yPos = normalizeDegrees(Y_AXIS, yPos);
+}
+
+/**
+ * Limita um ponto em passos aos limites dos eixos
+ *
+ * point			ponto a ser limitado
+ *
+ */
+void clampSteps(int32_t point[N_AXIS]) {
+	int32_t max[N_AXIS] = {degreesToSteps(X_AXIS, X_MAX), degreesToSteps(Y_AXIS, Y_MAX)};
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		if (isRotary(i)) {
+			continue;
+		}
+
+		if (point[i] >= max[i]) {
+			point[i] = max[i];
+		} else if (point[i] <= 0) {
+			point[i] = 0;
+		}
+	}
+}
+
+/**
+ * Retorna true se o eixo for rotativo contínuo
+ *
+ * axis				índice do eixo
+ *
+ */
+bool isRotary(uint8_t axis) {
+	return (ROTARY_AXES & (1 << axis)) != 0;
 }
 
+/**
+ * Retorna true se o fim de curso de algum eixo com limite físico estiver
+ * acionado. A interrupção só percebe a borda de descida, então uma chave
+ * já fechada (no boot ou depois de M999) precisa ser checada pelo nível
+ *
+ */
+bool limitActive() {
+	uint8_t axes = HARD_LIMIT_AXES & ~ROTARY_AXES;
+
+	//Chaves com pull-up, acionadas em nível baixo
+	return ((axes & (1 << X_AXIS)) && !xEndstop->read())
+			|| ((axes & (1 << Y_AXIS)) && !yEndstop->read());
+}
+
+/**
+ * Retorna o destino de um eixo rotativo na volta mais próxima da posição
+ * atual, pelo menor caminho. Eixos lineares retornam o próprio destino
+ *
+ * axis				índice do eixo
+ * current			posição atual em graus
+ * target			destino em graus
+ *
+ */
+float shortestPath(uint8_t axis, float current, float target) {
+	if (!isRotary(axis)) {
+		return target;
+	}
+
+	float delta = fmodf(target - current, 360.0f);
+	if (delta > 180.0f) {
+		delta -= 360.0f;
+	} else if (delta < -180.0f) {
+		delta += 360.0f;
+	}
+
+	return current + delta;
+}
+
+/**
+ * Leva um ângulo de um eixo rotativo para 0 a 360 graus. Eixos lineares
+ * retornam o próprio ângulo
+ *
+ * axis				índice do eixo
+ * degrees			ângulo a ser normalizado
+ *
+ */
+float normalizeDegrees(uint8_t axis, float degrees) {
+	if (!isRotary(axis)) {
+		return degrees;
+	}
+
+	degrees = fmodf(degrees, 360.0f);
+	if (degrees < 0.0f) {
+		degrees += 360.0f;
+	}
+
+	//Ângulos negativos muito pequenos arredondam para 360
+	if (degrees >= 360.0f) {
+		degrees = 0.0f;
+	}
+
+	return degrees;
+}
+
+/**
+ * Retorna os passos a somar a degreesToSteps para chegar à posição do
+ * planejador. Em eixos rotativos a posição em passos pode estar em qualquer
+ * volta, enquanto a posição programada fica entre 0 e 360 graus
+ *
+ * axis				índice do eixo
+ * current			posição programada atual em graus
+ *
+ */
+int32_t turnBase(uint8_t axis, float current) {
+	if (!isRotary(axis)) {
+		return 0;
+	}
+
+	//Diferença entre a posição do planejador e a programada, sempre um
+	//número inteiro de voltas
+	int32_t position[N_AXIS];
+	planner->getPosition(position);
+	return position[axis] - degreesToSteps(axis, current);
+}
+
+/**
+ * Leva a posição em passos dos eixos rotativos para a primeira volta,
+ * somando voltas inteiras, sem perder passos. Só deve ser chamado com os
+ * motores parados e a fila vazia
+ *
+ */
+void normalizeSteps() {
+	int32_t position[N_AXIS];
+	stepGenerator->getPosition(position);
+
+	bool changed = false;
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		if (isRotary(i) && ((position[i] < 0) || (position[i] >= stepsRevolution[i]))) {
+			position[i] %= stepsRevolution[i];
+			if (position[i] < 0) {
+				position[i] += stepsRevolution[i];
+			}
+			changed = true;
+		}
+	}
+
+	if (changed) {
+		planner->setPosition(position);
+		stepGenerator->setPosition(position);
+	}
+}
+
+/**
+ * Para a rotação contínua com desaceleração e espera os eixos pararem.
+ * A posição programada passa a ser aquela em que eles pararam
+ *
+ */
+void stopVelocity() {
+	if (!stepGenerator->velocityActive()) {
+		return;
+	}
+
+	for (uint8_t i = 0; i < N_AXIS; i++) {
+		stepGenerator->setVelocity(i, 0);
+	}
+	stepGenerator->synchronize();
+
+	int32_t position[N_AXIS];
+	stepGenerator->getPosition(position);
+	xPos = normalizeDegrees(X_AXIS, stepsToDegrees(X_AXIS, position[X_AXIS]));
+	yPos = normalizeDegrees(Y_AXIS, stepsToDegrees(Y_AXIS, position[Y_AXIS]));
+}
+
+/**
+ * Faz o homing de um eixo: busca rápida até o fim de curso, afastamento,
+ * aproximação lenta e afastamento final. O ponto do afastamento final,
+ * HOMING_PULL_OFF depois do acionamento na aproximação lenta, se torna o
+ * zero do eixo. Retorna false se o fim de curso não for encontrado ou não
+ * soltar
+ *
+ * axis				índice do eixo
+ * endstop			fim de curso do eixo
+ *
+ */
+bool home(uint8_t axis, DigitalIn* endstop) {
+	//Chave já acionada, afasta antes de buscar
+	if (!endstop->read() && !homingMove(axis, endstop, HOMING_PULL_OFF, HOMING_SEEK_FEEDRATE, false)) {
+		return false;
+	}
+
+	//Busca rápida, afastamento e aproximação lenta
+	if (!homingMove(axis, endstop, -HOMING_SEEK_DISTANCE, HOMING_SEEK_FEEDRATE, true)
+			|| !homingMove(axis, endstop, HOMING_PULL_OFF, HOMING_SEEK_FEEDRATE, false)
+			|| !homingMove(axis, endstop, -2 * HOMING_PULL_OFF, HOMING_LATCH_FEEDRATE, true)) {
+		return false;
+	}
+
+	//Afastamento final, a chave precisa soltar
+	if (!homingMove(axis, endstop, HOMING_PULL_OFF, HOMING_SEEK_FEEDRATE, false)) {
+		return false;
+	}
+
+	//Ponto afastado da chave é o zero do eixo, assim nenhum movimento dentro
+	//dos limites volta a acioná-la
+	int32_t position[N_AXIS];
+	stepGenerator->getPosition(position);
+	position[axis] = 0;
+	planner->setPosition(position);
+	stepGenerator->setPosition(position);
+
+	return true;
+}
+
+/**
+ * Move um eixo durante o homing e espera o fim do movimento. Na busca o
+ * movimento é interrompido pelo fim de curso e retorna true se ele foi
+ * acionado, no afastamento retorna true se ele soltou
+ *
+ * axis				índice do eixo
+ * endstop			fim de curso do eixo
+ * distance			distância em graus, negativa em direção ao fim de curso
+ * feedrate			velocidade em graus/min
+ * seek				true para buscar o fim de curso
+ *
+ */
+bool homingMove(uint8_t axis, DigitalIn* endstop, float distance, float feedrate, bool seek) {
+	int32_t target[N_AXIS];
+	stepGenerator->getPosition(target);
+	target[axis] += degreesToSteps(axis, distance);
+
+	//A espera só executa a fila, a parada vem da interrupção do fim de curso
+	stepGenerator->armEndstops(seek ? (1 << axis) : 0);
+	planner->bufferLine(target, feedrate);
+	stepGenerator->synchronize();
+
+	bool triggered = stepGenerator->getTriggeredEndstops() & (1 << axis);
+	stepGenerator->armEndstops(0);
+
+	//Descarta o restante do movimento interrompido
+	if (stepGenerator->isStopped()) {
+		stepGenerator->reset();
+	}
+
+	if (seek) {
+		return triggered;
+	}
+
+	return endstop->read();
+}
+
+/**
+ * Interrupções dos fins de curso, repassadas ao gerador de passos
+ *
+ */
+void xEndstopInterrupt() {
+	stepGenerator->endstopEvent(X_AXIS);
+}
+
+void yEndstopInterrupt() {
+	stepGenerator->endstopEvent(Y_AXIS);
+}
+
+/**
+ * Converte graus para a posição mais próxima em passos de um eixo
+ *
+ * axis				índice do eixo
+ * degrees			ângulo a ser convertido
+ *
+ */
+int32_t degreesToSteps(uint8_t axis, float degrees) {
+	//Multiplicar antes de dividir mantém a razão exata passos/360
+	return lroundf((degrees * stepsRevolution[axis]) / 360.0f);
+}
+
+/**
+ * Converte passos de um eixo para graus
+ *
+ * axis				índice do eixo
+ * steps			quantidade de passos a ser convertida
+ *
+ */
+float stepsToDegrees(uint8_t axis, int32_t steps) {
+	return ((float) steps * 360.0f) / stepsRevolution[axis];
+}
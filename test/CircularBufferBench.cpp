@@ -0,0 +1,115 @@
+/*
+ * CircularBufferBench.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//Benchmark no host da CircularBuffer contra a versão anterior (tamanho em
+//tempo de execução, alocada no heap, índices com %), mantida aqui só para a
+//comparação. Compilado e executado por make -C test bench
+
+#include "CircularBuffer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+#define BENCH_ROUNDS 2000000
+#define BENCH_BURST 48			//Bytes por rajada, perto de uma linha de G-code
+#define BENCH_SIZE 128			//Mesmo tamanho do buffer de recepção da serial
+
+//CircularBuffer até a fila SPSC de capacidade fixa
+template <class T>
+class OldCircularBuffer {
+public:
+	OldCircularBuffer(size_t size) :
+		buf_(std::unique_ptr<T[]>(new T[size])),
+		size_(size)
+	{
+		//Empty constructor
+	}
+
+	void put(T item) {
+		buf_[head_] = item;
+		head_ = (head_ + 1) % size_;
+
+		if (head_ == tail_) {
+			tail_ = (tail_ + 1) % size_;
+		}
+	}
+
+	T get(void) {
+		if (empty()) {
+			return T();
+		}
+
+		auto val = buf_[tail_];
+		tail_ = (tail_ + 1) % size_;
+
+		return val;
+	}
+
+	bool empty(void) {
+		return head_ == tail_;
+	}
+
+private:
+	std::unique_ptr<T[]> buf_;
+	size_t head_ = 0;
+	size_t tail_ = 0;
+	size_t size_;
+};
+
+//Tempo médio em ns de um put e um get, em rajadas de BENCH_BURST bytes
+template <class B>
+static double run(B& buffer) {
+	volatile uint8_t sink = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int32_t r = 0; r < BENCH_ROUNDS; r++) {
+		for (int32_t i = 0; i < BENCH_BURST; i++) {
+			buffer.put((uint8_t) i);
+		}
+		while (!buffer.empty()) {
+			sink = sink + buffer.get();
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::nano>(end - start).count() / ((double) BENCH_ROUNDS * BENCH_BURST);
+}
+
+int main() {
+	//Tamanho lido em tempo de execução, como na Serial, senão o compilador
+	//troca o % da versão anterior por uma máscara
+	volatile size_t size = BENCH_SIZE;
+	OldCircularBuffer<uint8_t> oldBuffer(size);
+	CircularBuffer<uint8_t, BENCH_SIZE> newBuffer;
+
+	//Duas passadas alternadas, a primeira também aquece cache e frequência
+	for (uint8_t pass = 0; pass < 2; pass++) {
+		printf("anterior   %.2f ns/byte (put + get)\n", run(oldBuffer));
+		printf("atual      %.2f ns/byte (put + get)\n", run(newBuffer));
+	}
+
+	return 0;
+}
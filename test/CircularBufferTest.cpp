@@ -0,0 +1,143 @@
+/*
+ * CircularBufferTest.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//Teste no host da CircularBuffer: sequências aleatórias de put/get, write/read
+//em bloco e readSpan/consume, writeSpan/commit, comparadas a uma std::deque
+//com a mesma capacidade. Compilado e executado por make -C test
+
+#include "CircularBuffer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+
+#define TEST_SIZE 16
+#define TEST_ITERATIONS 1000000
+#define TEST_MAX_CHUNK (TEST_SIZE + 4)		//Maior que a capacidade, força overflows
+
+int main() {
+	CircularBuffer<uint8_t, TEST_SIZE> buffer;
+	std::deque<uint8_t> model;
+	uint32_t modelOverflows = 0;
+	uint32_t mismatches = 0;
+	uint8_t next = 0;
+
+	srand(1);
+	for (int32_t it = 0; it < TEST_ITERATIONS; it++) {
+		uint8_t data[TEST_MAX_CHUNK];
+		size_t length = rand() % (TEST_MAX_CHUNK + 1);
+
+		switch (rand() % 6) {
+		case 0:
+			//Produtor: put por item
+			for (size_t i = 0; i < length; i++) {
+				bool accepted = buffer.put(next);
+				if (model.size() < TEST_SIZE) {
+					model.push_back(next);
+					mismatches += !accepted;
+				} else {
+					modelOverflows++;
+					mismatches += accepted;
+				}
+				next++;
+			}
+			break;
+
+		case 1:
+			//Produtor: write em bloco, o que não cabe é descartado
+			{
+				for (size_t i = 0; i < length; i++) {
+					data[i] = next++;
+				}
+				size_t expected = std::min(length, TEST_SIZE - model.size());
+				mismatches += buffer.write(data, length) != expected;
+				model.insert(model.end(), data, data + expected);
+				modelOverflows += length - expected;
+			}
+			break;
+
+		case 2:
+			//Produtor: escrita direta no trecho de writeSpan
+			{
+				CircularBuffer<uint8_t, TEST_SIZE>::Span span = buffer.writeSpan();
+				size_t count = std::min(length, span.length);
+				for (size_t i = 0; i < count; i++) {
+					span.data[i] = next;
+					model.push_back(next++);
+				}
+				buffer.commit(count);
+			}
+			break;
+
+		case 3:
+			//Consumidor: get e peek por item
+			for (size_t i = 0; i < length; i++) {
+				uint8_t expected = model.empty() ? 0 : model.front();
+				mismatches += buffer.peek() != expected;
+				mismatches += buffer.get() != expected;
+				if (!model.empty()) {
+					model.pop_front();
+				}
+			}
+			break;
+
+		case 4:
+			//Consumidor: read em bloco
+			{
+				size_t count = buffer.read(data, length);
+				mismatches += count != std::min(length, model.size());
+				for (size_t i = 0; i < count; i++) {
+					mismatches += data[i] != model.front();
+					model.pop_front();
+				}
+			}
+			break;
+
+		default:
+			//Consumidor: leitura direta no trecho de readSpan
+			{
+				CircularBuffer<uint8_t, TEST_SIZE>::Span span = buffer.readSpan();
+				mismatches += span.length > model.size();
+				size_t count = std::min(length, span.length);
+				for (size_t i = 0; i < count; i++) {
+					mismatches += span.data[i] != model.front();
+					model.pop_front();
+				}
+				buffer.consume(count);
+			}
+			break;
+		}
+
+		mismatches += buffer.size() != model.size();
+		mismatches += buffer.empty() != model.empty();
+		mismatches += buffer.full() != (model.size() == TEST_SIZE);
+	}
+
+	bool ok = (mismatches == 0) && (buffer.overflows() == modelOverflows);
+	printf("divergencias %u, overflows %u (esperado %u) %s\n", mismatches, buffer.overflows(),
+			modelOverflows, ok ? "ok" : "FALHOU");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+/*
+ * FastMathTest.cpp
+ *
+ * Copyright (c) 2018 Adriano Zenzen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+//Teste no host da precisão do FastMath, comparando com a libm em double.
+//Compilado e executado por make -C test
+
+#include "FastMath.h"
+
+#include <cmath>
+#include <cstdio>
+
+//Limites documentados em FastMath.h
+#define SINCOS_MAX_ERROR 2e-7
+#define ATAN2_MAX_ERROR 4e-7
+#define ASIN_MAX_ERROR 3e-7
+#define ASIN_RANGE 0.999			//Perto de +-1 a precisão do float domina
+
+static int failures = 0;
+
+static void check(const char* name, double error, double limit) {
+	bool ok = error < limit;
+	printf("%-10s erro maximo %.3g (limite %.3g) %s\n", name, error, limit, ok ? "ok" : "FALHOU");
+	if (!ok) {
+		failures++;
+	}
+}
+
+int main() {
+	//Seno e cosseno em |angle| < 50 rad
+	double sinError = 0.0, cosError = 0.0;
+	for (int32_t i = -2000000; i <= 2000000; i++) {
+		float angle = i * (50.0f / 2000000);
+		float s, c;
+		fastSinCos(angle, &s, &c);
+		sinError = fmax(sinError, fabs(s - sin((double) angle)));
+		cosError = fmax(cosError, fabs(c - cos((double) angle)));
+		sinError = fmax(sinError, fabs(fastSin(angle) - sin((double) angle)));
+		cosError = fmax(cosError, fabs(fastCos(angle) - cos((double) angle)));
+	}
+	check("sin", sinError, SINCOS_MAX_ERROR);
+	check("cos", cosError, SINCOS_MAX_ERROR);
+
+	//Arco tangente numa grade que cobre os quatro quadrantes e os eixos
+	double atan2Error = 0.0;
+	for (int32_t i = 0; i <= 2000; i++) {
+		for (int32_t j = 0; j <= 2000; j++) {
+			float y = (i - 1000) * 0.37f;
+			float x = (j - 1000) * 0.29f;
+			if ( (x == 0.0f) && (y == 0.0f) ) {
+				continue;
+			}
+			atan2Error = fmax(atan2Error, fabs(fastAtan2(y, x) - atan2((double) y, (double) x)));
+		}
+	}
+	check("atan2", atan2Error, ATAN2_MAX_ERROR);
+
+	double asinError = 0.0;
+	for (int32_t i = -1000000; i <= 1000000; i++) {
+		float x = i / 1000000.0f;
+		if (fabs(x) < ASIN_RANGE) {
+			asinError = fmax(asinError, fabs(fastAsin(x) - asin((double) x)));
+		}
+	}
+	check("asin", asinError, ASIN_MAX_ERROR);
+
+	//Raiz e inverso são arredondados corretamente, iguais aos do float
+	double sqrtError = 0.0, reciprocalError = 0.0;
+	for (int32_t i = 1; i < 1000000; i++) {
+		float x = i * 0.731f;
+		sqrtError = fmax(sqrtError, fabs(fastSqrt(x) - sqrtf(x)));
+		reciprocalError = fmax(reciprocalError, fabs(fastReciprocal(x) - 1.0f / x));
+	}
+	check("sqrt", sqrtError, 1e-30);
+	check("reciproco", reciprocalError, 1e-30);
+
+	if (fastSqrt(-1.0f) != 0.0f) {
+		printf("sqrt de negativo deveria ser 0 FALHOU\n");
+		failures++;
+	}
+
+	return (failures == 0) ? 0 : 1;
+}